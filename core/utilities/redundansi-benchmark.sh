@@ -0,0 +1,265 @@
+#!/usr/bin/env bash
+# Usage: redundansi-benchmark.sh [-d DIRECTORY] [-p] [-r RUNS] [-s MIB]
+#        REDUNDANSI [OPTION]...
+#
+# Measure the throughput of redundansi with synthetic input of various shapes
+# using cat(1) as a baseline. The corpus files are generated on demand and kept
+# so they can be reused by later runs. Any options following the path of the
+# redundansi executable are passed to it, so "-m" or "-j 4" can be
+# benchmarked, too.
+#
+# Options:
+#  -d DIRECTORY
+#       Directory where the corpus files are stored. This defaults to
+#       "${TMPDIR:-/tmp}/redundansi-benchmark".
+#  -h   Display this text and exit.
+#  -p   Pipe the corpus into each command instead of redirecting standard input
+#       from a file. This exercises the read(2) loop used when redundansi is
+#       part of a pipeline instead of the mmap(2) path used for regular files.
+#  -r RUNS
+#       Run each command this many times and report the fastest run. This
+#       defaults to 3.
+#  -s MIB
+#       Approximate size of each corpus file in MiB. This defaults to 64.
+#
+# Corpus Shapes:
+# - plain: Plain ASCII text without any escape sequences.
+# - 256-color: Every word has a 256-color foreground and some have a 256-color
+#   background.
+# - truecolor: Every word has an RGB foreground and some have an RGB
+#   background.
+# - long-lines: Lines of roughly 64 KiB with sparse attribute changes.
+# - crlf: Colored text with lines terminated by "\r\n".
+# - nul-heavy: Colored text where roughly 1 in 8 bytes is NUL.
+#
+set -e -u -o pipefail
+
+declare SHAPES="plain 256-color truecolor long-lines crlf nul-heavy"
+
+# Print a message to standard error then exit with a non-zero exit status.
+#
+# Arguments:
+# - $*: error message.
+#
+function die()
+{
+    echo "${0##*/}: $*" >&2
+    exit 1
+}
+
+# Display program usage information.
+#
+function usage()
+{
+    sed -n '/^# Usage:/,/^[^#]/ {
+        /^#/!q
+        s/^# \{0,1\}//p
+    }' "$0"
+}
+
+# Write a corpus of the given shape to standard output. The output is
+# deterministic: a pool of lines is generated with a fixed seed, then the pool
+# is repeated until the requested size has been reached.
+#
+# Arguments:
+# - $1: Name of the corpus shape.
+# - $2: Approximate size of the corpus in bytes.
+#
+function generate_corpus()
+{
+    awk -v shape="$1" -v size="$2" '
+    function word(  length_, text) {
+        for (length_ = 2 + int(rand() * 8); length_ > 0; length_--) {
+            text = text sprintf("%c", 97 + int(rand() * 26))
+        }
+
+        return text
+    }
+
+    function rgb() {
+        return int(rand() * 256) ";" int(rand() * 256) ";" int(rand() * 256)
+    }
+
+    function decorate(text) {
+        if (shape == "256-color") {
+            text = "\033[38;5;" int(rand() * 256) "m" text
+
+            if (rand() < 0.25) {
+                text = "\033[48;5;" int(rand() * 256) "m" text
+            }
+        } else if (shape == "truecolor") {
+            text = "\033[38;2;" rgb() "m" text
+
+            if (rand() < 0.25) {
+                text = "\033[48;2;" rgb() "m" text
+            }
+        } else if (shape != "plain" && rand() < 0.1) {
+            text = "\033[" (rand() < 0.5 ? 1 : 31 + int(rand() * 7)) "m" text
+        }
+
+        return text
+    }
+
+    function make_line(target,  text) {
+        text = decorate(word())
+
+        while (length(text) < target) {
+            text = text " " decorate(word())
+        }
+
+        if (shape != "plain") {
+            text = text "\033[0m"
+        }
+
+        return text (shape == "crlf" ? "\r" : "")
+    }
+
+    BEGIN {
+        srand(1)
+        lines = shape == "long-lines" ? 16 : 1024
+
+        for (n = 0; n < lines; n++) {
+            width = shape == "long-lines" ? 65536 : 20 + rand() * 100
+            pool[n] = make_line(width)
+
+            # NUL bytes cannot be written portably by AWK, so a placeholder
+            # is replaced by the caller.
+            if (shape == "nul-heavy") {
+                gsub(/[aeiou]/, "&\001", pool[n])
+            }
+        }
+
+        for (n = 0; written < size; n = (n + 1) % lines) {
+            print pool[n]
+            written += length(pool[n]) + 1
+        }
+    }
+    ' | if [[ "$1" = "nul-heavy" ]]; then tr '\001' '\000'; else cat; fi
+}
+
+# Run a command with the corpus as standard input several times and print the
+# shortest elapsed time in seconds.
+#
+# Arguments:
+# - $1: Path of the corpus file.
+# - $2: Number of times to run the command.
+# - $3: When this is "pipe", the corpus is piped into the command.
+# - $4...: Command to run.
+#
+function best_time()
+{
+    local best
+    local corpus="$1"
+    local elapsed
+    local mode="$3"
+    local runs="$2"
+
+    shift 3
+
+    for ((; runs > 0; runs--)); do
+        elapsed="$(
+            TIMEFORMAT="%3R"
+            {
+                if [[ "$mode" = "pipe" ]]; then
+                    time cat "$corpus" | "$@" > /dev/null
+                else
+                    time "$@" < "$corpus" > /dev/null
+                fi
+            } 2>&1
+        )"
+
+        if [[ -z "${best:-}" ]] || awk "BEGIN { exit !($elapsed < $best) }"
+        then
+            best="$elapsed"
+        fi
+    done
+
+    echo "$best"
+}
+
+function main()
+{
+    local bytes
+    local cat_time
+    local corpus
+    local directory="${TMPDIR:-/tmp}/redundansi-benchmark"
+    local lines
+    local mib=64
+    local mode="file"
+    local option
+    local redundansi_time
+    local runs=3
+    local shape
+
+    while getopts d:hpr:s: option; do
+        case "$option" in
+          d)
+            directory="$OPTARG"
+          ;;
+
+          h)
+            usage
+            return
+          ;;
+
+          p)
+            mode="pipe"
+          ;;
+
+          r)
+            runs="$OPTARG"
+          ;;
+
+          s)
+            mib="$OPTARG"
+          ;;
+
+          *)
+            return 1
+          ;;
+        esac
+    done
+
+    shift "$((OPTIND - 1))"
+
+    if [[ "$#" -eq 0 ]]; then
+        die "path of redundansi executable not specified"
+    elif ! [[ "$runs" =~ ^[1-9][0-9]*$ && "$mib" =~ ^[1-9][0-9]*$ ]]; then
+        die "the run count and corpus size must be positive integers"
+    fi
+
+    mkdir -p "$directory"
+
+    printf "%-11s %9s %10s %10s %10s %12s\n" \
+        "CORPUS" "MIB" "LINES" "CAT MB/S" "MB/S" "LINES/S"
+
+    for shape in $SHAPES; do
+        corpus="$directory/$shape-$mib.txt"
+
+        if ! [[ -e "$corpus" ]]; then
+            generate_corpus "$shape" "$((mib * 1048576))" > "$corpus.tmp"
+            mv "$corpus.tmp" "$corpus"
+        fi
+
+        bytes="$(wc -c < "$corpus")"
+        lines="$(wc -l < "$corpus")"
+        cat_time="$(best_time "$corpus" "$runs" "$mode" cat)"
+        redundansi_time="$(best_time "$corpus" "$runs" "$mode" "$@")"
+
+        awk -v shape="$shape" -v bytes="$bytes" -v lines="$lines" \
+            -v cat_time="$cat_time" -v redundansi_time="$redundansi_time" '
+        function rate(amount, seconds) {
+            # Timings are only reported with millisecond precision.
+            return amount / (seconds > 0 ? seconds : 0.001)
+        }
+
+        BEGIN {
+            printf "%-11s %9.1f %10d %10.1f %10.1f %12.0f\n", shape,
+                bytes / 1048576, lines, rate(bytes / 1e6, cat_time),
+                rate(bytes / 1e6, redundansi_time),
+                rate(lines, redundansi_time)
+        }'
+    done
+}
+
+main "$@"
@@ -7,164 +7,3347 @@
  * which results in attributes not being applied to multiple lines. RedundANSI
  * generates explicit, redundant ANSI SGR escape sequences for every line in
  * the data its processing to ensure Less renders the output the way a terminal
- * would.
+ * would. OSC 8 hyperlinks that span multiple lines are repeated the same way.
  *
- * Make: $(CC) -O1 -D_POSIX_C_SOURCE=200809L $(CFLAGS) -o $@ $?
+ * The stream processing logic can also be embedded in other programs; refer to
+ * "redundansi.h" for details.
+ *
+ * Make: $(CC) -O1 -D_POSIX_C_SOURCE=200809L $(CFLAGS) -o $@ $? -lpthread
  * Copyright: Eric Pruitt (https://www.codevat.com/)
  * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
  */
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "redundansi.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /**
  * Get the number of members in a fixed-length array.
  *
  * Arguments:
- * - array
+ * - array
+ *
+ * Return: The number of members in the array.
+ */
+#define ARRAY_LENGTH(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * Broadcast a byte to every byte of a 64-bit word.
+ *
+ * Arguments:
+ * - byte
+ *
+ * Return: A word where every byte has the given value.
+ */
+#define BROADCAST_BYTE(byte) ((uint64_t) (byte) * UINT64_C(0x0101010101010101))
+
+/**
+ * Determine whether a 64-bit word contains a zero byte.
+ *
+ * Arguments:
+ * - word
+ *
+ * Return: A non-zero value if any byte in the word is zero.
+ */
+#define HAS_ZERO_BYTE(word) \
+    (((word) - BROADCAST_BYTE(0x01)) & ~(word) & BROADCAST_BYTE(0x80))
+
+/**
+ * Define consecutive members of a lookup table indexed by byte.
+ *
+ * Arguments:
+ * - byte: First byte in the range.
+ * - value: Value assigned to every byte in the range.
+ */
+#define BYTE_RANGE_1(byte, value) [(byte)] = (value)
+#define BYTE_RANGE_2(byte, value) \
+    BYTE_RANGE_1(byte, value), BYTE_RANGE_1((byte) + 1, value)
+#define BYTE_RANGE_4(byte, value) \
+    BYTE_RANGE_2(byte, value), BYTE_RANGE_2((byte) + 2, value)
+#define BYTE_RANGE_8(byte, value) \
+    BYTE_RANGE_4(byte, value), BYTE_RANGE_4((byte) + 4, value)
+#define BYTE_RANGE_16(byte, value) \
+    BYTE_RANGE_8(byte, value), BYTE_RANGE_8((byte) + 8, value)
+
+/**
+ * Classes of bytes distinguished by the escape sequence parser.
+ */
+typedef enum {
+    BYTE_OTHER = 0,
+    BYTE_NEWLINE,
+    BYTE_ESCAPE,
+    BYTE_BELL,
+    // Parameter bytes of a control sequence.
+    BYTE_DIGIT,
+    BYTE_SEMICOLON,
+    BYTE_PRIVATE,
+    // Intermediate bytes of a control sequence.
+    BYTE_INTERMEDIATE,
+    // Final bytes of a control sequence. The brackets are also the second
+    // byte of CSI and OSC sequences, and a backslash terminates OSC strings.
+    BYTE_CSI_OPENER,
+    BYTE_OSC_OPENER,
+    BYTE_SGR_FINAL,
+    BYTE_FINAL,
+    BYTE_CLASS_COUNT,
+} byte_class_et;
+
+/**
+ * States of the escape sequence parser.
+ */
+typedef enum {
+    PARSER_GROUND = 0,
+    PARSER_ESCAPE,
+    PARSER_CSI_PARAMETER,
+    PARSER_CSI_IGNORE,
+    PARSER_OSC_STRING,
+    PARSER_STATE_COUNT,
+} parser_state_et;
+
+/**
+ * Actions performed by the escape sequence parser when it consumes a byte.
+ */
+typedef enum {
+    ACTION_NONE = 0,
+    ACTION_NEWLINE,
+    ACTION_ESCAPE,
+    ACTION_CSI_START,
+    ACTION_DIGIT,
+    ACTION_SEPARATOR,
+    ACTION_SGR,
+    ACTION_OSC_START,
+    ACTION_OSC_PUT,
+    ACTION_OSC_END,
+} parser_action_et;
+
+/**
+ * Entry in the transition table of the escape sequence parser.
+ */
+typedef struct parser_transition_st {
+    /**
+     * A parser_state_et value.
+     */
+    uint8_t state;
+    /**
+     * A parser_action_et value.
+     */
+    uint8_t action;
+} parser_transition_st;
+
+/**
+ * Map of every byte to a byte_class_et value.
+ */
+static const uint8_t BYTE_CLASSES[256] = {
+    ['\007'] = BYTE_BELL,
+    ['\n'] = BYTE_NEWLINE,
+    ['\033'] = BYTE_ESCAPE,
+    BYTE_RANGE_16(' ', BYTE_INTERMEDIATE),
+    BYTE_RANGE_8('0', BYTE_DIGIT),
+    BYTE_RANGE_2('8', BYTE_DIGIT),
+    [':'] = BYTE_PRIVATE,
+    [';'] = BYTE_SEMICOLON,
+    BYTE_RANGE_4('<', BYTE_PRIVATE),
+    BYTE_RANGE_16('@', BYTE_FINAL),
+    BYTE_RANGE_8('P', BYTE_FINAL),
+    BYTE_RANGE_2('X', BYTE_FINAL),
+    ['Z'] = BYTE_FINAL,
+    ['['] = BYTE_CSI_OPENER,
+    ['\\'] = BYTE_FINAL,
+    [']'] = BYTE_OSC_OPENER,
+    BYTE_RANGE_2('^', BYTE_FINAL),
+    BYTE_RANGE_8('`', BYTE_FINAL),
+    BYTE_RANGE_4('h', BYTE_FINAL),
+    ['l'] = BYTE_FINAL,
+    ['m'] = BYTE_SGR_FINAL,
+    BYTE_RANGE_2('n', BYTE_FINAL),
+    BYTE_RANGE_8('p', BYTE_FINAL),
+    BYTE_RANGE_4('x', BYTE_FINAL),
+    BYTE_RANGE_2('|', BYTE_FINAL),
+    ['~'] = BYTE_FINAL,
+};
+
+/**
+ * Define a parser_transition_st.
+ *
+ * Arguments:
+ * - state: Name of the next state without the "PARSER_" prefix.
+ * - action: Name of the action without the "ACTION_" prefix.
+ */
+#define TRANSITION(state, action) {PARSER_ ## state, ACTION_ ## action}
+
+/**
+ * Transitions shared by every state: newlines always terminate escape
+ * sequences, and an escape always starts a new one.
+ */
+#define COMMON_TRANSITIONS \
+    [BYTE_NEWLINE] = TRANSITION(GROUND, NEWLINE), \
+    [BYTE_ESCAPE] = TRANSITION(ESCAPE, ESCAPE)
+
+/**
+ * Transition table of the escape sequence parser indexed by the current state
+ * and the class of the byte being consumed. Any combination not listed here
+ * returns the parser to the ground state, so malformed sequences are
+ * discarded. Only CSI sequences ending in "m" and OSC strings are
+ * interpreted; other CSI sequences are consumed without any side effects.
+ */
+static const parser_transition_st
+  PARSER_TRANSITIONS[PARSER_STATE_COUNT][BYTE_CLASS_COUNT] = {
+    [PARSER_GROUND] = {
+        COMMON_TRANSITIONS,
+    },
+    [PARSER_ESCAPE] = {
+        COMMON_TRANSITIONS,
+        [BYTE_CSI_OPENER] = TRANSITION(CSI_PARAMETER, CSI_START),
+        [BYTE_OSC_OPENER] = TRANSITION(OSC_STRING, OSC_START),
+    },
+    [PARSER_CSI_PARAMETER] = {
+        COMMON_TRANSITIONS,
+        [BYTE_DIGIT] = TRANSITION(CSI_PARAMETER, DIGIT),
+        [BYTE_SEMICOLON] = TRANSITION(CSI_PARAMETER, SEPARATOR),
+        [BYTE_PRIVATE] = TRANSITION(CSI_IGNORE, NONE),
+        [BYTE_INTERMEDIATE] = TRANSITION(CSI_IGNORE, NONE),
+        [BYTE_SGR_FINAL] = TRANSITION(GROUND, SGR),
+    },
+    [PARSER_CSI_IGNORE] = {
+        COMMON_TRANSITIONS,
+        [BYTE_DIGIT] = TRANSITION(CSI_IGNORE, NONE),
+        [BYTE_SEMICOLON] = TRANSITION(CSI_IGNORE, NONE),
+        [BYTE_PRIVATE] = TRANSITION(CSI_IGNORE, NONE),
+        [BYTE_INTERMEDIATE] = TRANSITION(CSI_IGNORE, NONE),
+    },
+    // OSC strings are terminated by BEL or by ST ("\033\\"). Like other
+    // terminal parsers, the string is dispatched as soon as the escape is
+    // read, and the backslash is then handled by the escape state.
+    [PARSER_OSC_STRING] = {
+        [BYTE_NEWLINE] = TRANSITION(GROUND, NEWLINE),
+        [BYTE_ESCAPE] = TRANSITION(ESCAPE, OSC_END),
+        [BYTE_BELL] = TRANSITION(GROUND, OSC_END),
+        [BYTE_OTHER] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_DIGIT] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_SEMICOLON] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_PRIVATE] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_INTERMEDIATE] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_CSI_OPENER] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_OSC_OPENER] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_SGR_FINAL] = TRANSITION(OSC_STRING, OSC_PUT),
+        [BYTE_FINAL] = TRANSITION(OSC_STRING, OSC_PUT),
+    },
+};
+
+/**
+ * Parameter values are not accumulated beyond this limit to avoid overflows.
+ * No valid parameter is anywhere near this large.
+ */
+#define SGR_PARAMETER_LIMIT 100000
+
+/**
+ * Flags representing the boolean attributes tracked in a redundansi_state_st.
+ */
+typedef enum {
+    SGR_BOLD = 1 << 0,
+    SGR_FAINT = 1 << 1,
+    SGR_ITALIC = 1 << 2,
+    SGR_UNDERLINE = 1 << 3,
+    SGR_BLINK = 1 << 4,
+    SGR_RAPID_BLINK = 1 << 5,
+    SGR_REVERSE = 1 << 6,
+    SGR_HIDDEN = 1 << 7,
+    SGR_STRIKE = 1 << 8,
+    // Set when an attribute that is not tracked, like a bright color, may be
+    // in effect. Only a reset clears it.
+    SGR_UNTRACKED = 1 << 9,
+} sgr_flag_et;
+
+/**
+ * Color types that can be stored in the color members of a
+ * redundansi_state_st. The type occupies the most significant byte of a packed
+ * color, and the lower 24 bits contain a palette index or an RGB triplet.
+ */
+typedef enum {
+    COLOR_DEFAULT = 0,
+    COLOR_BASIC,
+    COLOR_INDEXED,
+    COLOR_RGB,
+} color_type_et;
+
+/**
+ * Pack a color type and value into a single integer.
+ *
+ * Arguments:
+ * - type: A color_type_et value.
+ * - value: Palette index or RGB triplet.
+ *
+ * Return: Packed color.
+ */
+#define PACK_COLOR(type, value) \
+    (((uint32_t) (type) << 24) | (uint32_t) (value))
+
+/**
+ * Get the type of a packed color.
+ *
+ * Arguments:
+ * - color
+ *
+ * Return: A color_type_et value.
+ */
+#define COLOR_TYPE(color) ((color_type_et) ((color) >> 24))
+
+/**
+ * Signature at the start of every index file. The final character is the
+ * version of the file format.
+ */
+#define INDEX_MAGIC "RDNSIDX2"
+
+/**
+ * Size of an index file header: the signature followed by the interval, the
+ * size of the indexed file and its modification time, each stored as a
+ * little-endian 64-bit integer.
+ */
+#define INDEX_HEADER_SIZE 32
+
+/**
+ * Size of each checkpoint record in an index file: the line number and offset
+ * as little-endian 64-bit integers, the foreground, background and underline
+ * colors as little-endian 32-bit integers, the attribute flags as a
+ * little-endian 16-bit integer, then the offset and size of the last OSC 8
+ * escape sequence as little-endian 64-bit and 16-bit integers.
+ */
+#define INDEX_RECORD_SIZE 40
+
+/**
+ * Maximum length of an escape sequence generated by sgr_transition_to_escape
+ * excluding the null byte.
+ */
+#define MINIFIED_ESCAPE_MAX (REDUNDANSI_ESCAPE_MAX + sizeof("0;") - 1)
+
+/**
+ * Determine whether two redundansi_state_st structures represent the same
+ * set of attributes.
+ *
+ * Arguments:
+ * - a
+ * - b
+ *
+ * Return: A boolean indicating whether the states are equal.
+ */
+static bool sgr_state_equal(const redundansi_state_st *a,
+  const redundansi_state_st *b)
+{
+    return a->flags == b->flags && a->fgcolor == b->fgcolor &&
+      a->bgcolor == b->bgcolor && a->ulcolor == b->ulcolor;
+}
+
+/**
+ * Write the decimal representation of a number followed by a semicolon.
+ *
+ * Arguments:
+ * - dest: Output buffer.
+ * - value: Number to write. This must be less than 1000.
+ *
+ * Return: A pointer to the byte following the semicolon.
+ */
+static char *append_parameter(char *dest, unsigned int value)
+{
+    if (value >= 100) {
+        *dest++ = (char) ('0' + value / 100);
+    }
+
+    if (value >= 10) {
+        *dest++ = (char) ('0' + value / 10 % 10);
+    }
+
+    *dest++ = (char) ('0' + value % 10);
+    *dest++ = ';';
+    return dest;
+}
+
+/**
+ * Write the SGR parameters for a packed color.
+ *
+ * Arguments:
+ * - dest: Output buffer.
+ * - color: Packed color.
+ * - base: 30 for foreground colors, 40 for background colors and 50 for
+ *   underline colors.
+ *
+ * Return: A pointer to the byte following the last parameter written.
+ */
+static char *append_color(char *dest, uint32_t color, unsigned int base)
+{
+    switch (COLOR_TYPE(color)) {
+      case COLOR_BASIC:
+        dest = append_parameter(dest, base + (color & 0xff));
+        break;
+
+      case COLOR_INDEXED:
+        dest = append_parameter(dest, base + 8);
+        dest = append_parameter(dest, 5);
+        dest = append_parameter(dest, color & 0xff);
+        break;
+
+      case COLOR_RGB:
+        dest = append_parameter(dest, base + 8);
+        dest = append_parameter(dest, 2);
+        dest = append_parameter(dest, (color >> 16) & 0xff);
+        dest = append_parameter(dest, (color >> 8) & 0xff);
+        dest = append_parameter(dest, color & 0xff);
+        break;
+
+      case COLOR_DEFAULT:
+        break;
+    }
+
+    return dest;
+}
+
+/**
+ * Generate an escape sequence that changes the attributes of a terminal from
+ * one state to another. Attributes that are already in effect are not
+ * repeated, but when any attribute must be turned off, the sequence starts
+ * with a reset since the parameters for disabling individual attributes are
+ * not interpreted consistently by terminals.
+ *
+ * Arguments:
+ * - from: Attributes currently in effect.
+ * - to: Attributes that should be in effect.
+ * - full: When this is true, every attribute in "to" is included even if it is
+ *   already in effect.
+ * - dest: Output buffer. This must be at least MINIFIED_ESCAPE_MAX + 1 bytes.
+ *
+ * Return: The length of the escape sequence which will be 0 when no change is
+ * needed.
+ */
+static size_t sgr_transition_to_escape(const redundansi_state_st *from,
+  const redundansi_state_st *to, bool full, char *dest)
+{
+    static const struct {
+        uint16_t flag;
+        unsigned int parameter;
+    } flags[] = {
+        {SGR_BOLD, 1},
+        {SGR_FAINT, 2},
+        {SGR_ITALIC, 3},
+        {SGR_UNDERLINE, 4},
+        {SGR_BLINK, 5},
+        {SGR_RAPID_BLINK, 6},
+        {SGR_REVERSE, 7},
+        {SGR_HIDDEN, 8},
+        {SGR_STRIKE, 9},
+    };
+
+    char *cursor = dest + 2;
+    redundansi_state_st changes = *to;
+
+    if ((from->flags & ~to->flags) ||
+      (COLOR_TYPE(from->fgcolor) && !COLOR_TYPE(to->fgcolor)) ||
+      (COLOR_TYPE(from->bgcolor) && !COLOR_TYPE(to->bgcolor)) ||
+      (COLOR_TYPE(from->ulcolor) && !COLOR_TYPE(to->ulcolor))) {
+        cursor = append_parameter(cursor, 0);
+    } else if (!full) {
+        changes.flags &= (uint16_t) ~from->flags;
+
+        if (changes.fgcolor == from->fgcolor) {
+            changes.fgcolor = PACK_COLOR(COLOR_DEFAULT, 0);
+        }
+
+        if (changes.bgcolor == from->bgcolor) {
+            changes.bgcolor = PACK_COLOR(COLOR_DEFAULT, 0);
+        }
+
+        if (changes.ulcolor == from->ulcolor) {
+            changes.ulcolor = PACK_COLOR(COLOR_DEFAULT, 0);
+        }
+    }
+
+    for (size_t n = 0; n < ARRAY_LENGTH(flags); n++) {
+        if (changes.flags & flags[n].flag) {
+            cursor = append_parameter(cursor, flags[n].parameter);
+        }
+    }
+
+    cursor = append_color(cursor, changes.fgcolor, 30);
+    cursor = append_color(cursor, changes.bgcolor, 40);
+    cursor = append_color(cursor, changes.ulcolor, 50);
+
+    if (cursor == dest + 2) {
+        dest[0] = '\0';
+        return 0;
+    }
+
+    dest[0] = '\033';
+    dest[1] = '[';
+
+    // Replace the trailing semicolon with the final byte.
+    cursor[-1] = 'm';
+    *cursor = '\0';
+    return (size_t) (cursor - dest);
+}
+
+/**
+ * Generate a single escape sequence that applies every attribute in an
+ * redundansi_state_st.
+ *
+ * Arguments:
+ * - state: Attributes to render.
+ * - dest: Output buffer. This must be at least REDUNDANSI_ESCAPE_MAX + 1
+ *   bytes.
+ *
+ * Return: The length of the escape sequence which will be 0 when no
+ * attributes are set.
+ */
+static size_t sgr_state_to_escape(const redundansi_state_st *state, char *dest)
+{
+    static const redundansi_state_st defaults = {0};
+
+    return sgr_transition_to_escape(&defaults, state, true, dest);
+}
+
+/**
+ * Convert the parameters of an extended color specification ("38;...",
+ * "48;..." or "58;...") or a basic color specification into a packed color.
+ *
+ * Arguments:
+ * - values: Parameters of the color specification.
+ * - count: Number of parameters in "values".
+ * - color: Output pointer for the packed color.
+ *
+ * Return: A boolean indicating whether the parameters described a valid
+ * color.
+ */
+static bool parameters_to_color(const int *values, size_t count,
+  uint32_t *color)
+{
+    if (values[0] % 10 != 8) {
+        *color = PACK_COLOR(COLOR_BASIC, values[0] % 10);
+        return true;
+    }
+
+    if (count == 3 && values[1] == 5 && values[2] >= 0 &&
+      values[2] < 256) {
+        *color = PACK_COLOR(COLOR_INDEXED, values[2]);
+        return true;
+    }
+
+    if (count == 5 && values[1] == 2) {
+        for (size_t n = 2; n < 5; n++) {
+            if (values[n] < 0 || values[n] > 255) {
+                return false;
+            }
+        }
+
+        *color = PACK_COLOR(COLOR_RGB,
+            (uint32_t) values[2] << 16 | (uint32_t) values[3] << 8 |
+            (uint32_t) values[4]);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Update the attribute state with the parameters for a single attribute.
+ *
+ * Arguments:
+ * - state: Attribute state to update.
+ * - values: Parameters of the attribute specification.
+ * - count: Number of parameters in "values".
+ */
+static void apply_sgr_parameters(redundansi_state_st *state, const int *values,
+  size_t count)
+{
+    uint32_t *color = NULL;
+    int first = values[0];
+
+    if (first == 0) {
+        *state = (redundansi_state_st) {0};
+    } else if (first == 1) {
+        state->flags |= SGR_BOLD;
+    } else if (first == 2) {
+        state->flags |= SGR_FAINT;
+    } else if (first == 3) {
+        state->flags |= SGR_ITALIC;
+    } else if (first == 4) {
+        state->flags |= SGR_UNDERLINE;
+    } else if (first == 5) {
+        state->flags &= (uint16_t) ~SGR_RAPID_BLINK;
+        state->flags |= SGR_BLINK;
+    } else if (first == 6) {
+        state->flags &= (uint16_t) ~SGR_BLINK;
+        state->flags |= SGR_RAPID_BLINK;
+    } else if (first == 7) {
+        state->flags |= SGR_REVERSE;
+    } else if (first == 8) {
+        state->flags |= SGR_HIDDEN;
+    } else if (first == 9) {
+        state->flags |= SGR_STRIKE;
+    } else if (first == 22) {
+        state->flags &= (uint16_t) ~(SGR_BOLD | SGR_FAINT);
+    } else if (first == 23) {
+        state->flags &= (uint16_t) ~SGR_ITALIC;
+    } else if (first == 24) {
+        state->flags &= (uint16_t) ~SGR_UNDERLINE;
+    } else if (first == 25) {
+        state->flags &= (uint16_t) ~(SGR_BLINK | SGR_RAPID_BLINK);
+    } else if (first == 27) {
+        state->flags &= (uint16_t) ~SGR_REVERSE;
+    } else if (first == 28) {
+        state->flags &= (uint16_t) ~SGR_HIDDEN;
+    } else if (first == 29) {
+        state->flags &= (uint16_t) ~SGR_STRIKE;
+    } else if (first >= 30 && first <= 38) {
+        color = &state->fgcolor;
+    } else if (first == 39) {
+        state->fgcolor = PACK_COLOR(COLOR_DEFAULT, 0);
+    } else if (first >= 40 && first <= 48) {
+        color = &state->bgcolor;
+    } else if (first == 49) {
+        state->bgcolor = PACK_COLOR(COLOR_DEFAULT, 0);
+    } else if (first == 58) {
+        color = &state->ulcolor;
+    } else if (first == 59) {
+        state->ulcolor = PACK_COLOR(COLOR_DEFAULT, 0);
+    } else {
+        state->flags |= SGR_UNTRACKED;
+    }
+
+    // Terminals do not agree on how to handle malformed colors, so they are
+    // treated like attributes that are not tracked.
+    if (color && !parameters_to_color(values, count, color)) {
+        state->flags |= SGR_UNTRACKED;
+    }
+}
+
+/**
+ * Apply the SGR attribute specification that has been read to the pending
+ * attributes of the escape sequence being parsed.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ */
+static void apply_sgr_attribute(redundansi_st *rd)
+{
+    apply_sgr_parameters(&rd->pending, rd->attribute, rd->attribute_length);
+
+    if (rd->shadow) {
+        apply_sgr_parameters(&rd->pending_shadow, rd->attribute,
+                             rd->attribute_length);
+    }
+
+    rd->attribute_length = 0;
+}
+
+/**
+ * Append the SGR parameter that has been read to the current attribute
+ * specification, and apply the specification once it is complete. Extended
+ * foreground, background and underline colors span 3 ("38;5;N") or 5
+ * ("38;2;R;G;B") parameters while every other attribute consists of a single
+ * parameter.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ */
+static void end_sgr_parameter(redundansi_st *rd)
+{
+    const int *values = rd->attribute;
+    size_t count = ++rd->attribute_length;
+
+    rd->attribute[count - 1] = rd->parameter;
+    rd->parameter = 0;
+
+    if ((values[0] != 38 && values[0] != 48 && values[0] != 58) ||
+      (count == 2 && values[1] != 2 && values[1] != 5) ||
+      (count == 3 && values[1] == 5) || count == 5) {
+        apply_sgr_attribute(rd);
+    }
+}
+
+/**
+ * Update the hyperlink that is repeated at the start of each line with the
+ * contents of an OSC string. Hyperlinks have the form "8;PARAMETERS;URI", and
+ * an empty URI closes the hyperlink. A hyperlink that is too long to track is
+ * treated like a closed one.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - string: Contents of the OSC string. When "length" exceeds the size of
+ *   "rd->osc", only the first sizeof(rd->osc) bytes need to be present.
+ * - length: Length of the OSC string.
+ * - offset: Offset of the escape sequence relative to the start of the
+ *   stream.
+ * - size: Size of the escape sequence in the input.
+ *
+ * Return: A boolean indicating whether the string was a hyperlink.
+ */
+static bool set_link(redundansi_st *rd, const char *string, size_t length,
+  uint64_t offset, uint64_t size)
+{
+    const char *uri = NULL;
+
+    if (length < 2 || memcmp(string, "8;", 2) || (length <= sizeof(rd->osc) &&
+      !(uri = memchr(string + 2, ';', length - 2)))) {
+        return false;
+    }
+
+    if (!uri || uri + 1 == string + length) {
+        rd->link_length = 0;
+    } else {
+        memcpy(rd->link, "\033]", 2);
+        memcpy(rd->link + 2, string, length);
+        memcpy(rd->link + 2 + length, "\033\\", 2);
+        rd->link_length = length + 4;
+    }
+
+    // Only the escape sequence of a hyperlink that is in effect needs to be
+    // found again to resume a stream.
+    rd->link_offset = offset;
+    rd->link_size = rd->link_length ? (uint16_t) size : 0;
+    return true;
+}
+
+/**
+ * Write the data between two pointers if there is any.
+ *
+ * Arguments:
+ * - writer: Function used to write the data. This may be NULL.
+ * - context: Argument passed to the writer.
+ * - start: Start of the data.
+ * - end: End of the data.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int write_between(redundansi_writer_ft writer, void *context,
+  const char *start, const char *end)
+{
+    if (writer && end != start) {
+        return writer(context, start, (size_t) (end - start));
+    }
+
+    return 0;
+}
+
+/**
+ * Write the bytes of the escape sequence being held back while minifying,
+ * and stop holding them.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - writer: Function used to write the data. This may be NULL.
+ * - context: Argument passed to the writer.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int release_held_bytes(redundansi_st *rd, redundansi_writer_ft writer,
+  void *context)
+{
+    size_t length = rd->held_length;
+
+    rd->held_length = 0;
+    return write_between(writer, context, rd->held, rd->held + length);
+}
+
+/**
+ * Bring the attributes of the output up to date with those of the input while
+ * minifying.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - printable: Indicates whether printable text will be written next. Since
+ *   pagers start every line with the default attributes, the first text on a
+ *   line is always preceded by every attribute in effect.
+ * - writer: Function used to write the data. This may be NULL.
+ * - context: Argument passed to the writer.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int update_emitted_state(redundansi_st *rd, bool printable,
+  redundansi_writer_ft writer, void *context)
+{
+    char escape[MINIFIED_ESCAPE_MAX + 1];
+    size_t length;
+
+    bool full = printable && rd->line_start;
+
+    if (printable) {
+        rd->line_start = false;
+    }
+
+    if (!full && sgr_state_equal(&rd->state, &rd->emitted)) {
+        return 0;
+    }
+
+    if ((length = sgr_transition_to_escape(&rd->emitted, &rd->state, full,
+      escape)) || (full && rd->link_length)) {
+        rd->stats.prefixes++;
+    }
+
+    rd->emitted = rd->state;
+
+    if (write_between(writer, context, escape, escape + length)) {
+        return -1;
+    }
+
+    // Hyperlinks are only reopened at the start of a line since they are not
+    // affected by SGR resets.
+    return full ? write_between(writer, context, rd->link,
+                                rd->link + rd->link_length) : 0;
+}
+
+/**
+ * Find the next byte that cannot simply be copied from the input to the output
+ * while outside of an escape sequence: a newline, an escape or a NUL byte.
+ * Bytes are examined 16 at a time using SSE2 when it is available and 8 at a
+ * time otherwise.
+ *
+ * Arguments:
+ * - cursor: Start of the data to search.
+ * - end: End of the data to search.
+ *
+ * Return: A pointer to the first special byte or "end" if there are none.
+ */
+static const char *find_special_byte(const char *cursor, const char *end)
+{
+    uint64_t word;
+
+#ifdef __SSE2__
+    int mask;
+    __m128i chunk;
+
+    const __m128i escapes = _mm_set1_epi8('\033');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i nuls = _mm_setzero_si128();
+
+    for (; end - cursor >= 16; cursor += 16) {
+        chunk = _mm_loadu_si128((const __m128i *) cursor);
+        mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newlines),
+                         _mm_cmpeq_epi8(chunk, escapes)),
+            _mm_cmpeq_epi8(chunk, nuls)
+        ));
+
+        if (mask) {
+            return cursor + __builtin_ctz((unsigned int) mask);
+        }
+    }
+#endif
+
+    for (; end - cursor >= 8; cursor += 8) {
+        memcpy(&word, cursor, sizeof(word));
+
+        if (HAS_ZERO_BYTE(word) ||
+          HAS_ZERO_BYTE(word ^ BROADCAST_BYTE('\n')) ||
+          HAS_ZERO_BYTE(word ^ BROADCAST_BYTE('\033'))) {
+            break;
+        }
+    }
+
+    for (; cursor < end; cursor++) {
+        if (*cursor == '\n' || *cursor == '\033' || *cursor == '\0') {
+            break;
+        }
+    }
+
+    return cursor;
+}
+
+/**
+ * Initialize a redundansi_st structure for a new stream.
+ *
+ * Arguments:
+ * - rd: Structure to initialize.
+ */
+void redundansi_init(redundansi_st *rd)
+{
+    redundansi_resume(rd, NULL, false);
+}
+
+/**
+ * Initialize a redundansi_st structure to process a stream starting somewhere
+ * other than its beginning. The position must not be inside of an escape
+ * sequence, so this will typically be the start of a line.
+ *
+ * Arguments:
+ * - rd: Structure to initialize.
+ * - initial: Attributes in effect at the start of the input. This may be NULL
+ *   to start with the terminal defaults.
+ * - after_newline: When this is true, the input is treated as though it
+ *   follows a newline, so the attributes will be emitted before the first
+ *   byte.
+ *
+ * When minifying, the output is assumed to already have the initial
+ * attributes.
+ */
+void redundansi_resume(redundansi_st *rd, const redundansi_state_st *initial,
+  bool after_newline)
+{
+    *rd = (redundansi_st) {
+        .link_offset = UINT64_MAX,
+        .prefix_dirty = true,
+        .print_escapes = after_newline,
+    };
+
+    if (initial) {
+        rd->state = *initial;
+        rd->emitted = *initial;
+    }
+}
+
+/**
+ * Restore the hyperlink in effect at a checkpoint once a stream has been
+ * resumed with redundansi_resume.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - data: Escape sequence described by the "link_offset" and "link_size"
+ *   members of the checkpoint.
+ * - size: Number of bytes in "data".
+ * - offset: Offset of the escape sequence relative to the start of the
+ *   stream.
+ *
+ * Return: 0 on success and -1 if "data" does not start with an OSC 8 escape
+ * sequence, in which case errno is set to EINVAL.
+ */
+int redundansi_resume_link(redundansi_st *rd, const char *data, size_t size,
+  uint64_t offset)
+{
+    const char *cursor = data + 2;
+    const char *end = data + size;
+
+    if (size < 2 || memcmp(data, "\033]", 2)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (cursor < end && *cursor != '\007' && *cursor != '\033' &&
+      *cursor != '\n') {
+        cursor++;
+    }
+
+    if (cursor == end || *cursor == '\n' || !set_link(rd, data + 2,
+      (size_t) (cursor - data - 2), offset, (uint64_t) (cursor + 1 - data))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Process a block of input. The input of a stream may be split into blocks
+ * arbitrarily.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - data: Input data.
+ * - size: Number of bytes in "data".
+ * - writer: Function used to write the processed data. Data that is copied
+ *   verbatim from the input is passed to the writer as a pointer into "data".
+ *   When this is NULL, the input is parsed, but nothing is written.
+ * - context: Argument passed to the writer.
+ *
+ * Return: 0 if the data was processed successfully and -1 if there was an
+ * error writing the output.
+ */
+int redundansi_feed(redundansi_st *rd, const char *data, size_t size,
+  redundansi_writer_ft writer, void *context)
+{
+    unsigned char byte;
+    redundansi_checkpoint_st checkpoint;
+    bool holding;
+    uint8_t previous;
+    const char *run;
+    const char *span_end;
+    size_t span_length;
+    parser_transition_st transition;
+
+    const char *cursor = data;
+    const char *end = data + size;
+    int status = 0;
+
+    if (size && rd->deferred_length &&
+      redundansi_write_deferred(rd, writer, context)) {
+        status = -1;
+    }
+
+    while (cursor < end) {
+        // Printing escapes after the last newline in the file can result in
+        // an extra, blank line being rendered by a pager, so we only print
+        // escapes after reading the next byte following a newline since we
+        // know at that stage that the newline was not end of the file.
+        if (rd->print_escapes) {
+            if (rd->minify) {
+                // When minifying, the attributes are written along with the
+                // first printable text on the line instead.
+                rd->line_start = true;
+            } else {
+                // The prefix is only regenerated when an attribute has
+                // changed since it was last rendered.
+                if (rd->prefix_dirty) {
+                    rd->prefix_length = sgr_state_to_escape(&rd->state,
+                                                            rd->prefix);
+                    rd->prefix_dirty = false;
+                }
+
+                if (rd->prefix_length || rd->link_length) {
+                    rd->stats.prefixes++;
+                }
+
+                if (writer && ((rd->prefix_length &&
+                  writer(context, rd->prefix, rd->prefix_length)) ||
+                  (rd->link_length &&
+                  writer(context, rd->link, rd->link_length)))) {
+                    status = -1;
+                }
+            }
+
+            rd->print_escapes = false;
+        }
+
+        // Outside of escape sequences, only newlines, escapes and NUL bytes
+        // need special handling, so everything in between is copied to the
+        // output in a single write.
+        if (rd->parser == PARSER_GROUND) {
+            span_end = find_special_byte(cursor, end);
+
+            if (span_end != cursor) {
+                span_length = (size_t) (span_end - cursor);
+
+                if (rd->minify &&
+                  update_emitted_state(rd, true, writer, context)) {
+                    status = -1;
+                }
+
+                if (writer && writer(context, cursor, span_length)) {
+                    status = -1;
+                }
+
+                if ((cursor = span_end) == end) {
+                    break;
+                }
+            }
+        }
+
+        if (!*cursor) {
+            // The terminal emulators I tested seem to just ignore NUL bytes
+            // inside of escape sequences. In Less, they seem to cause
+            // rendering issues, so we simply drop NUL bytes so the rendered
+            // text is the same regardless of whether or not it is fed to Less.
+            cursor++;
+            continue;
+        }
+
+        // Bytes are fed to the parser until it returns to the ground state
+        // or a NUL byte is found, and they are then copied to the output in
+        // a single write.
+        run = cursor;
+
+        do {
+            byte = (unsigned char) *cursor++;
+            previous = rd->parser;
+            transition = PARSER_TRANSITIONS[previous][BYTE_CLASSES[byte]];
+            holding = previous == PARSER_ESCAPE ||
+              previous == PARSER_CSI_PARAMETER;
+            rd->parser = transition.state;
+
+            // A sequence that ends as anything other than an SGR sequence or
+            // an OSC string is rejected, and so is one that is interrupted
+            // by a newline or an escape. OSC strings are counted once they
+            // have been interpreted, and a backslash following an escape is
+            // the terminator of an OSC string rather than a sequence.
+            if (previous != PARSER_GROUND &&
+              (transition.state == PARSER_GROUND ||
+              transition.action == ACTION_ESCAPE) &&
+              transition.action != ACTION_SGR &&
+              transition.action != ACTION_OSC_END &&
+              !(previous == PARSER_ESCAPE && byte == '\\')) {
+                rd->stats.rejected_escapes++;
+            }
+
+            // When minifying, anything that might be an SGR sequence is held
+            // back until the sequence has been terminated, and complete SGR
+            // sequences are handled once they have been applied. Everything
+            // else is written as-is. If a sequence is too long to hold, the
+            // output is brought up to date with the attributes preceding it
+            // like it is for sequences with attributes that are not tracked,
+            // and the sequence is then written as-is.
+            if (rd->minify && transition.action != ACTION_SGR) {
+                if (byte == '\033') {
+                    if (write_between(writer, context, run, cursor - 1) ||
+                      release_held_bytes(rd, writer, context)) {
+                        status = -1;
+                    }
+
+                    rd->held[0] = '\033';
+                    rd->held_length = 1;
+                    rd->held_overflow = false;
+                    run = cursor;
+                } else if (rd->parser == PARSER_CSI_PARAMETER) {
+                    if (!rd->held_overflow &&
+                      rd->held_length < sizeof(rd->held)) {
+                        rd->held[rd->held_length++] = (char) byte;
+                        run = cursor;
+                    } else if (!rd->held_overflow) {
+                        if (update_emitted_state(rd, rd->line_start, writer,
+                          context) ||
+                          release_held_bytes(rd, writer, context)) {
+                            status = -1;
+                        }
+
+                        rd->held_overflow = true;
+                    }
+                } else if (holding || transition.action == ACTION_NEWLINE) {
+                    if (write_between(writer, context, run, cursor - 1) ||
+                      release_held_bytes(rd, writer, context) ||
+                      (transition.action == ACTION_NEWLINE &&
+                      update_emitted_state(rd, false, writer, context))) {
+                        status = -1;
+                    }
+
+                    rd->held_overflow = false;
+                    run = cursor - 1;
+                }
+            }
+
+            switch (transition.action) {
+              case ACTION_NONE:
+                break;
+
+              case ACTION_NEWLINE:
+                rd->print_escapes = true;
+                rd->lines++;
+                rd->stats.lines++;
+
+                if (rd->checkpoint &&
+                  rd->lines % rd->checkpoint_interval == 0) {
+                    checkpoint = (redundansi_checkpoint_st) {
+                        .line = rd->lines,
+                        .offset = rd->offset + (uint64_t) (cursor - data),
+                        .state = rd->state,
+                        .link_offset = rd->link_offset,
+                        .link_size = rd->link_size,
+                    };
+
+                    if (rd->checkpoint(rd->checkpoint_context, &checkpoint)) {
+                        status = -1;
+                    }
+                }
+                break;
+
+              case ACTION_ESCAPE:
+                rd->stats.escapes++;
+                break;
+
+              // Attributes are applied to a copy of the state as each
+              // parameter is read, and the copy only replaces the real state
+              // once the sequence has been terminated.
+              case ACTION_CSI_START:
+                rd->parameter = 0;
+                rd->attribute_length = 0;
+                rd->pending = rd->state;
+
+                if (rd->shadow) {
+                    rd->pending_shadow = *rd->shadow;
+                }
+                break;
+
+              case ACTION_DIGIT:
+                if (rd->parameter < SGR_PARAMETER_LIMIT) {
+                    rd->parameter = rd->parameter * 10 + (byte - '0');
+                }
+                break;
+
+              // Per the ANSI spec, empty parameters are equivalent to 0.
+              case ACTION_SEPARATOR:
+                end_sgr_parameter(rd);
+                break;
+
+              case ACTION_SGR:
+                rd->stats.sgr_escapes++;
+                end_sgr_parameter(rd);
+
+                // Incomplete extended color specifications are ignored.
+                if (rd->attribute_length) {
+                    apply_sgr_attribute(rd);
+                }
+
+                // When minifying, SGR sequences are dropped, and the net
+                // change is written later. A sequence that may leave
+                // attributes that are not tracked in effect is written as-is
+                // instead once the output is up to date with the attributes
+                // preceding it. Otherwise, a later reset could turn those
+                // attributes off. At the start of a line, the attributes are
+                // written in full first so the line prefix cannot override
+                // the sequence.
+                if (rd->minify) {
+                    if (rd->held_overflow ||
+                      (rd->pending.flags & SGR_UNTRACKED)) {
+                        if (!rd->held_overflow &&
+                          (update_emitted_state(rd, rd->line_start, writer,
+                          context) ||
+                          release_held_bytes(rd, writer, context))) {
+                            status = -1;
+                        }
+
+                        rd->emitted = rd->pending;
+                    } else {
+                        rd->held_length = 0;
+                        run = cursor;
+                    }
+
+                    rd->held_overflow = false;
+                }
+
+                if (!sgr_state_equal(&rd->state, &rd->pending)) {
+                    rd->state = rd->pending;
+                    rd->prefix_dirty = true;
+                }
+
+                if (rd->shadow) {
+                    *rd->shadow = rd->pending_shadow;
+                }
+                break;
+
+              // The contents of OSC strings are collected so hyperlinks can
+              // be repeated on every line they span.
+              case ACTION_OSC_START:
+                rd->osc_length = 0;
+                rd->osc_offset = rd->offset + (uint64_t) (cursor - data) - 2;
+                break;
+
+              case ACTION_OSC_PUT:
+                if (rd->osc_length < sizeof(rd->osc)) {
+                    rd->osc[rd->osc_length++] = (char) byte;
+                } else {
+                    rd->osc_length = SIZE_MAX;
+                }
+                break;
+
+              case ACTION_OSC_END:
+                if (byte == '\033') {
+                    rd->stats.escapes++;
+                }
+
+                // Only hyperlinks are tracked. Other OSC strings are written
+                // as-is.
+                if (!set_link(rd, rd->osc, rd->osc_length, rd->osc_offset,
+                  rd->offset + (uint64_t) (cursor - data) - rd->osc_offset)) {
+                    rd->stats.rejected_escapes++;
+                }
+                break;
+            }
+        } while (cursor < end && *cursor && rd->parser != PARSER_GROUND);
+
+        if (write_between(writer, context, run, cursor)) {
+            status = -1;
+        }
+    }
+
+    rd->offset += size;
+    rd->stats.bytes += size;
+    return status;
+}
+
+/**
+ * Signal the end of a stream's input. Any pending output is written except for
+ * escape sequences that are deferred as described for "reset_at_end", and the
+ * structure is reset so it can be used for a new stream.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - writer: Function used to write any pending output. This may be NULL.
+ * - context: Argument passed to the writer.
+ *
+ * Return: 0 if the stream was finished successfully and -1 if there was an
+ * error writing the output.
+ */
+int redundansi_finish(redundansi_st *rd, redundansi_writer_ft writer,
+  void *context)
+{
+    redundansi_checkpoint_ft checkpoint = rd->checkpoint;
+    void *checkpoint_context = rd->checkpoint_context;
+    uint64_t checkpoint_interval = rd->checkpoint_interval;
+    char deferred[sizeof(rd->deferred)];
+    size_t deferred_length;
+    char escapes[sizeof(rd->deferred)];
+    bool minify = rd->minify;
+    bool reset_at_end = rd->reset_at_end;
+    redundansi_stats_st stats;
+
+    size_t length = 0;
+    int status = 0;
+
+    static const char close_link[] = "\033]8;;\033\\";
+    static const redundansi_state_st defaults = {0};
+    static const char reset[] = "\033[m";
+
+    // Without minification, the attributes are only emitted once a byte
+    // following a newline has been read, so nothing is ever pending at the end
+    // of the input. When minifying, a truncated escape sequence may be held
+    // back, and attribute changes after the last printable text have not
+    // been written yet. Those changes are irrelevant when the output is about
+    // to be reset.
+    if (minify && (release_held_bytes(rd, writer, context) ||
+      (!reset_at_end && update_emitted_state(rd, false, writer, context)))) {
+        status = -1;
+    }
+
+    if (reset_at_end && !sgr_state_equal(minify ? &rd->emitted : &rd->state,
+      &defaults)) {
+        memcpy(escapes, reset, sizeof(reset) - 1);
+        length = sizeof(reset) - 1;
+    }
+
+    if (reset_at_end && rd->link_length) {
+        memcpy(escapes + length, close_link, sizeof(close_link) - 1);
+        length += sizeof(close_link) - 1;
+    }
+
+    // When the input ends with a newline, the escape sequences are deferred
+    // for the same reason the attributes following a newline are. Anything
+    // deferred at the end of a previous stream has already been written if
+    // this one had any input, so nothing is overwritten.
+    if (length && rd->print_escapes) {
+        memcpy(rd->deferred, escapes, length);
+        rd->deferred_length = length;
+    } else if (write_between(writer, context, escapes, escapes + length)) {
+        status = -1;
+    }
+
+    memcpy(deferred, rd->deferred, rd->deferred_length);
+    deferred_length = rd->deferred_length;
+
+    // A sequence truncated by the end of the input is also rejected.
+    if (rd->parser != PARSER_GROUND) {
+        rd->stats.rejected_escapes++;
+    }
+
+    stats = rd->stats;
+    redundansi_init(rd);
+    rd->stats = stats;
+    rd->minify = minify;
+    rd->reset_at_end = reset_at_end;
+    rd->checkpoint = checkpoint;
+    rd->checkpoint_context = checkpoint_context;
+    rd->checkpoint_interval = checkpoint_interval;
+    memcpy(rd->deferred, deferred, deferred_length);
+    rd->deferred_length = deferred_length;
+    return status;
+}
+
+/**
+ * Write the escape sequences redundansi_finish deferred at the end of the
+ * previous stream. This is only needed when output other than that of the
+ * next stream follows since redundansi_feed writes them before anything else.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - writer: Function used to write the escape sequences. This may be NULL.
+ * - context: Argument passed to the writer.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+int redundansi_write_deferred(redundansi_st *rd, redundansi_writer_ft writer,
+  void *context)
+{
+    size_t length = rd->deferred_length;
+
+    rd->deferred_length = 0;
+    return write_between(writer, context, rd->deferred, rd->deferred + length);
+}
+
+/**
+ * Store a 64-bit integer in little-endian byte order.
+ *
+ * Arguments:
+ * - dest: Output buffer.
+ * - value: Number to store.
+ * - width: Number of bytes to store.
+ */
+static void store_le(unsigned char *dest, uint64_t value, size_t width)
+{
+    for (size_t n = 0; n < width; n++, value >>= 8) {
+        dest[n] = (unsigned char) (value & 0xff);
+    }
+}
+
+/**
+ * Load an integer stored in little-endian byte order.
+ *
+ * Arguments:
+ * - src: Input buffer.
+ * - width: Number of bytes to load.
+ *
+ * Return: The loaded number.
+ */
+static uint64_t load_le(const unsigned char *src, size_t width)
+{
+    uint64_t value = 0;
+
+    while (width--) {
+        value = value << 8 | src[width];
+    }
+
+    return value;
+}
+
+/**
+ * Write the header of an index file. It must be written before any
+ * checkpoints.
+ *
+ * Arguments:
+ * - file: Index file.
+ * - header: Index metadata.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+int redundansi_index_write_header(FILE *file,
+  const redundansi_index_header_st *header)
+{
+    unsigned char buffer[INDEX_HEADER_SIZE];
+
+    memcpy(buffer, INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1);
+    store_le(buffer + 8, header->interval, 8);
+    store_le(buffer + 16, header->source_size, 8);
+    store_le(buffer + 24, (uint64_t) header->source_mtime, 8);
+
+    return fwrite(buffer, sizeof(buffer), 1, file) == 1 ? 0 : -1;
+}
+
+/**
+ * Append a checkpoint to an index file. This is a redundansi_checkpoint_ft
+ * implementation.
+ *
+ * Arguments:
+ * - context: A `FILE *` for the index file.
+ * - checkpoint: Checkpoint to write.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+int redundansi_index_write_checkpoint(void *context,
+  const redundansi_checkpoint_st *checkpoint)
+{
+    unsigned char buffer[INDEX_RECORD_SIZE];
+
+    store_le(buffer, checkpoint->line, 8);
+    store_le(buffer + 8, checkpoint->offset, 8);
+    store_le(buffer + 16, checkpoint->state.fgcolor, 4);
+    store_le(buffer + 20, checkpoint->state.bgcolor, 4);
+    store_le(buffer + 24, checkpoint->state.ulcolor, 4);
+    store_le(buffer + 28, checkpoint->state.flags, 2);
+    store_le(buffer + 30, checkpoint->link_offset, 8);
+    store_le(buffer + 38, checkpoint->link_size, 2);
+
+    return fwrite(buffer, sizeof(buffer), 1, context) == 1 ? 0 : -1;
+}
+
+/**
+ * Read the header of an index file.
+ *
+ * Arguments:
+ * - fd: File descriptor of the index file.
+ * - header: Output pointer for the index metadata.
+ *
+ * Return: 0 on success and -1 otherwise. When the file is not an index or the
+ * header is invalid, errno is set to EINVAL.
+ */
+int redundansi_index_read_header(int fd, redundansi_index_header_st *header)
+{
+    unsigned char buffer[INDEX_HEADER_SIZE];
+    ssize_t count;
+
+    if ((count = pread(fd, buffer, sizeof(buffer), 0)) == -1) {
+        return -1;
+    } else if ((size_t) count != sizeof(buffer) ||
+      memcmp(buffer, INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    header->interval = load_le(buffer + 8, 8);
+    header->source_size = load_le(buffer + 16, 8);
+    header->source_mtime = (int64_t) load_le(buffer + 24, 8);
+
+    if (!header->interval) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Find the last checkpoint in an index that does not come after a given line.
+ * Only a single record is read from the index.
+ *
+ * Arguments:
+ * - fd: File descriptor of the index file.
+ * - header: Metadata read from the index file with
+ *   redundansi_index_read_header.
+ * - line: Number of lines preceding the position being sought.
+ * - checkpoint: Output pointer for the checkpoint. When the index contains no
+ *   suitable checkpoints, this will represent the beginning of the stream.
+ *
+ * Return: 0 on success and -1 otherwise. When the index is malformed, errno is
+ * set to EINVAL.
+ */
+int redundansi_index_lookup(int fd, const redundansi_index_header_st *header,
+  uint64_t line, redundansi_checkpoint_st *checkpoint)
+{
+    unsigned char buffer[INDEX_RECORD_SIZE];
+    ssize_t count;
+    uint64_t records;
+    struct stat status;
+
+    uint64_t record = line / header->interval;
+
+    *checkpoint = (redundansi_checkpoint_st) {0};
+
+    if (fstat(fd, &status)) {
+        return -1;
+    }
+
+    // The index may end before the line being sought if the indexed file was
+    // still growing, so the last checkpoint is used instead.
+    records = status.st_size < INDEX_HEADER_SIZE ? 0 :
+      (uint64_t) (status.st_size - INDEX_HEADER_SIZE) / INDEX_RECORD_SIZE;
+
+    if (record > records) {
+        record = records;
+    }
+
+    if (record == 0) {
+        return 0;
+    }
+
+    count = pread(fd, buffer, sizeof(buffer),
+      (off_t) (INDEX_HEADER_SIZE + (record - 1) * INDEX_RECORD_SIZE));
+
+    if (count == -1) {
+        return -1;
+    } else if ((size_t) count != sizeof(buffer) ||
+      load_le(buffer, 8) != record * header->interval) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    checkpoint->line = load_le(buffer, 8);
+    checkpoint->offset = load_le(buffer + 8, 8);
+    checkpoint->state.fgcolor = (uint32_t) load_le(buffer + 16, 4);
+    checkpoint->state.bgcolor = (uint32_t) load_le(buffer + 20, 4);
+    checkpoint->state.ulcolor = (uint32_t) load_le(buffer + 24, 4);
+    checkpoint->state.flags = (uint16_t) load_le(buffer + 28, 2);
+    checkpoint->link_offset = load_le(buffer + 30, 8);
+    checkpoint->link_size = (uint16_t) load_le(buffer + 38, 2);
+    return 0;
+}
+
+#ifndef REDUNDANSI_NO_MAIN
+/**
+ * Exit status to indicate the command the child process encountered an
+ * unspecified error.
+ */
+#define EXIT_CHILD_FAILURE 126
+
+/**
+ * Exit status to indicate the command the child process tried to execute was
+ * not found.
+ */
+#define EXIT_EXEC_ENOENT 127
+
+/**
+ * Exit status to indicate one or more I/O errors were encountered while
+ * reading input or writing output.
+ */
+#define EXIT_IO_ERROR 2
+
+/**
+ * Default number of lines between checkpoints in an index file.
+ */
+#define DEFAULT_INDEX_INTERVAL 8192
+
+/**
+ * Packed color that cannot be produced by an SGR escape sequence. This is used
+ * as a sentinel when determining which attributes a chunk of input changes.
+ */
+#define COLOR_UNSET PACK_COLOR(0xff, 0)
+
+/**
+ * Target size of the chunks input is divided into for parallel processing.
+ * The actual size will be larger since chunks end at newlines.
+ */
+#define PARALLEL_CHUNK_SIZE (4 * 1024 * 1024)
+
+/**
+ * Number of chunks per job that may be rendered ahead of the output during
+ * parallel processing. This limits how much memory is used to hold rendered
+ * chunks that have not been written yet.
+ */
+#define PARALLEL_WINDOW_PER_JOB 2
+
+/**
+ * Number of slots in each ring buffer used by the pipelined mode.
+ */
+#define RING_SLOTS 8
+
+/**
+ * Capacity of each slot in a ring buffer.
+ */
+#define RING_SLOT_SIZE 65536
+
+// IOV_MAX is an XSI extension, so it may be hidden by the feature test
+// macros. 1024 is the limit on Linux, macOS and the BSDs.
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// F_SETPIPE_SZ is Linux-specific, and glibc hides it unless _GNU_SOURCE is
+// defined, so the value from the kernel headers is used instead.
+#if defined(__linux__) && !defined(F_SETPIPE_SZ)
+#define F_SETPIPE_SZ 1031
+#endif
+
+/**
+ * Value returned by getopt_long for "--stats" which has no short form.
+ */
+#define STATS_OPTION 256
+
+/**
+ * Capacity requested for the pipe used to send the output to a child process.
+ * This is the largest size unprivileged processes can use by default on Linux.
+ */
+#define CHILD_PIPE_CAPACITY (1024 * 1024)
+
+/**
+ * Maximum number of vectors passed to a single writev(2) call.
+ */
+#define VECTOR_WRITER_IOV_COUNT (IOV_MAX < 1024 ? IOV_MAX : 1024)
+
+/**
+ * Writer that batches data into writev(2) calls. Data that will not change
+ * before the writer is flushed, like the contents of a memory-mapped input
+ * file, is written directly from its original location without being copied
+ * into a userspace buffer.
+ */
+typedef struct vector_writer_st {
+    /**
+     * Output file descriptor.
+     */
+    int fd;
+    /**
+     * Start of the memory region whose contents can be referenced in place.
+     */
+    const char *stable;
+    /**
+     * End of the memory region whose contents can be referenced in place.
+     */
+    const char *stable_end;
+    /**
+     * Queued vectors.
+     */
+    struct iovec iov[VECTOR_WRITER_IOV_COUNT];
+    /**
+     * Number of queued vectors.
+     */
+    int iovcnt;
+    /**
+     * Buffer for data that must be copied before it is queued.
+     */
+    char scratch[16384];
+    /**
+     * Number of bytes used in "scratch".
+     */
+    size_t scratch_used;
+    /**
+     * Indicates whether a write error has occurred.
+     */
+    bool error;
+} vector_writer_st;
+
+/**
+ * Section of the input processed by a single worker during parallel
+ * processing.
+ */
+typedef struct chunk_st {
+    /**
+     * Start of the chunk's data.
+     */
+    const char *start;
+    /**
+     * Number of bytes in the chunk.
+     */
+    size_t size;
+    /**
+     * Attributes in effect at the end of the chunk assuming the chunk started
+     * with the terminal defaults.
+     */
+    redundansi_state_st from_default;
+    /**
+     * Attributes in effect at the end of the chunk assuming the chunk started
+     * with every flag set and colors set to COLOR_UNSET.
+     */
+    redundansi_state_st from_unset;
+    /**
+     * Attributes in effect at the start of the chunk.
+     */
+    redundansi_state_st initial;
+    /**
+     * Last OSC 8 escape sequence in the chunk that set or cleared a
+     * hyperlink or NULL if there is none.
+     */
+    const char *link;
+    /**
+     * Size of the escape sequence at "link" or 0 when it cleared the
+     * hyperlink.
+     */
+    size_t link_size;
+    /**
+     * OSC 8 escape sequence that set the hyperlink in effect at the start of
+     * the chunk. This is only meaningful when "initial_link_size" is not 0.
+     */
+    const char *initial_link;
+    /**
+     * Size of the escape sequence at "initial_link" or 0 when no hyperlink is
+     * in effect at the start of the chunk.
+     */
+    size_t initial_link_size;
+    /**
+     * Rendered chunk.
+     */
+    char *output;
+    /**
+     * Number of bytes in "output".
+     */
+    size_t output_size;
+    /**
+     * Indicates whether the chunk has been rendered.
+     */
+    bool done;
+    /**
+     * Indicates whether an error occurred while rendering the chunk.
+     */
+    bool error;
+} chunk_st;
+
+/**
+ * State shared by the threads used for parallel processing.
+ */
+typedef struct parallel_st {
+    /**
+     * Chunks of input.
+     */
+    chunk_st *chunks;
+    /**
+     * Number of members in "chunks".
+     */
+    size_t chunk_count;
+    /**
+     * Index of the next chunk to be claimed by a worker.
+     */
+    size_t next;
+    /**
+     * Number of chunks that have been written to the output.
+     */
+    size_t written;
+    /**
+     * Maximum number of chunks that may be claimed but not yet written.
+     */
+    size_t window;
+    /**
+     * Processing pass: 1 to determine how each chunk changes the attributes
+     * and 2 to render the chunks.
+     */
+    int pass;
+    /**
+     * Indicates whether SGR escape sequences should be minified.
+     */
+    bool minify;
+    /**
+     * Indicates whether the output should end with the default attributes.
+     */
+    bool reset_at_end;
+    /**
+     * Stream the input belongs to. The escape sequences deferred at the end of
+     * the last chunk are stored in it.
+     */
+    redundansi_st *stream;
+    /**
+     * Lock protecting "next", "written" and the "done" member of each chunk.
+     */
+    pthread_mutex_t lock;
+    /**
+     * Condition signaled whenever a chunk is rendered or written.
+     */
+    pthread_cond_t cond;
+} parallel_st;
+
+/**
+ * Block of data stored in a ring_st.
+ */
+typedef struct ring_slot_st {
+    /**
+     * Number of bytes in "data". A slot with a size of 0 marks the end of the
+     * data.
+     */
+    size_t size;
+    /**
+     * Contents of the slot.
+     */
+    char data[RING_SLOT_SIZE];
+} ring_slot_st;
+
+/**
+ * Single-producer, single-consumer ring buffer. Slots are passed between the
+ * two threads by atomically advancing "head" and "tail" without locking. The
+ * mutex and condition variable are only used by a thread that has to sleep
+ * because the ring is full or empty.
+ */
+typedef struct ring_st {
+    /**
+     * Number of slots that have been published by the producer.
+     */
+    atomic_size_t head;
+    /**
+     * Number of slots that have been released by the consumer.
+     */
+    atomic_size_t tail;
+    /**
+     * Indicates whether a thread may be waiting on "cond".
+     */
+    atomic_bool sleeping;
+    /**
+     * Array of RING_SLOTS slots.
+     */
+    ring_slot_st *slots;
+    /**
+     * Lock used with "cond".
+     */
+    pthread_mutex_t lock;
+    /**
+     * Condition signaled when "head" or "tail" changes while a thread is
+     * sleeping.
+     */
+    pthread_cond_t cond;
+} ring_st;
+
+/**
+ * Shared state of the threads used by the pipelined mode.
+ */
+typedef struct pipeline_st {
+    /**
+     * Blocks read from the input.
+     */
+    ring_st input;
+    /**
+     * Blocks waiting to be written to the output.
+     */
+    ring_st output;
+    /**
+     * Output slot currently being filled by the processing thread.
+     */
+    ring_slot_st *pending;
+    /**
+     * Input file descriptor.
+     */
+    int infd;
+    /**
+     * Output file descriptor.
+     */
+    int outfd;
+    /**
+     * Indicates whether reading the input failed.
+     */
+    atomic_bool read_error;
+    /**
+     * Indicates whether writing the output failed.
+     */
+    atomic_bool write_error;
+    /**
+     * Number of bytes held in both rings.
+     */
+    atomic_uint_least64_t buffered;
+} pipeline_st;
+
+/**
+ * Counters reported by "--stats" in addition to the ones tracked by the
+ * library. The members are atomic since they are updated by several threads
+ * and read by a signal handler.
+ */
+typedef struct statistics_st {
+    /**
+     * Number of bytes written to the output.
+     */
+    atomic_uint_least64_t bytes_out;
+    /**
+     * Nanoseconds spent waiting for input.
+     */
+    atomic_uint_least64_t read_ns;
+    /**
+     * Nanoseconds spent waiting for output to be written.
+     */
+    atomic_uint_least64_t write_ns;
+    /**
+     * Largest number of bytes held in userspace buffers at once.
+     */
+    atomic_uint_least64_t peak_buffered;
+    /**
+     * Sums of the library counters of streams processed by worker threads.
+     */
+    atomic_uint_least64_t bytes;
+    atomic_uint_least64_t lines;
+    atomic_uint_least64_t sgr_escapes;
+    atomic_uint_least64_t rejected_escapes;
+    atomic_uint_least64_t prefixes;
+} statistics_st;
+
+/**
+ * Counters reported by "--stats".
+ */
+static statistics_st statistics;
+
+/**
+ * Stream processed by the main thread whose library counters are included in
+ * statistics reports. This may be NULL.
+ */
+static const redundansi_st *volatile statistics_stream;
+
+/**
+ * File descriptor statistics are written to or -1 if they are disabled.
+ */
+static int statistics_fd = -1;
+
+/**
+ * Mapping of standard input that is being processed and its size. The start
+ * is NULL when no input is mapped.
+ */
+static const char *volatile input_mapping;
+static volatile size_t input_mapping_size;
+
+/**
+ * Indicates whether the mapped input was truncated while it was processed.
+ */
+static volatile sig_atomic_t input_truncated;
+
+/**
+ * File descriptor of "/dev/zero" used to replace the pages of the mapped input
+ * that no longer exist or -1 if it has not been opened.
+ */
+static int zero_fd = -1;
+
+/**
+ * Size of a memory page.
+ */
+static size_t page_size;
+
+/**
+ * Read the monotonic clock.
+ *
+ * Return: The current time in nanoseconds.
+ */
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * Add the time elapsed since a previous reading of the monotonic clock to a
+ * counter.
+ *
+ * Arguments:
+ * - counter: Counter to update.
+ * - start: Earlier value returned by monotonic_ns.
+ */
+static void add_elapsed_ns(atomic_uint_least64_t *counter, uint64_t start)
+{
+    atomic_fetch_add(counter, monotonic_ns() - start);
+}
+
+/**
+ * Record the number of bytes currently held in userspace buffers.
+ *
+ * Arguments:
+ * - bytes
+ */
+static void record_buffered(uint64_t bytes)
+{
+    uint_least64_t peak = atomic_load(&statistics.peak_buffered);
+
+    while (bytes > peak && !atomic_compare_exchange_weak(
+      &statistics.peak_buffered, &peak, bytes));
+}
+
+/**
+ * Add the library counters of a stream processed by a worker thread to the
+ * statistics.
+ *
+ * Arguments:
+ * - stats: Counters to add.
+ */
+static void add_stream_statistics(const redundansi_stats_st *stats)
+{
+    atomic_fetch_add(&statistics.bytes, stats->bytes);
+    atomic_fetch_add(&statistics.lines, stats->lines);
+    atomic_fetch_add(&statistics.sgr_escapes, stats->sgr_escapes);
+    atomic_fetch_add(&statistics.rejected_escapes, stats->rejected_escapes);
+    atomic_fetch_add(&statistics.prefixes, stats->prefixes);
+}
+
+/**
+ * Append a named counter to a statistics report. Only async-signal-safe
+ * operations are used since reports may be generated by a signal handler.
+ *
+ * Arguments:
+ * - dest: Output buffer.
+ * - name: Name of the counter including the leading space and trailing "=".
+ * - value
+ *
+ * Return: A pointer to the byte following the counter.
+ */
+static char *append_counter(char *dest, const char *name, uint64_t value)
+{
+    char digits[20];
+    size_t count = 0;
+
+    while (*name) {
+        *dest++ = *name++;
+    }
+
+    do {
+        digits[count++] = (char) ('0' + value % 10);
+    } while ((value /= 10));
+
+    while (count) {
+        *dest++ = digits[--count];
+    }
+
+    return dest;
+}
+
+/**
+ * Write the statistics to the statistics file descriptor as a single line.
+ * This is async-signal-safe. Counters read while the input is still being
+ * processed may be slightly out of date.
+ */
+static void report_statistics(void)
+{
+    char buffer[512];
+    redundansi_stats_st stats = {0};
+
+    char *cursor = buffer;
+    const redundansi_st *rd = statistics_stream;
+
+    if (rd) {
+        stats = rd->stats;
+    }
+
+    stats.sgr_escapes += atomic_load(&statistics.sgr_escapes);
+    stats.rejected_escapes += atomic_load(&statistics.rejected_escapes);
+
+    cursor = append_counter(cursor, "redundansi: bytes_in=",
+                            stats.bytes + atomic_load(&statistics.bytes));
+    cursor = append_counter(cursor, " bytes_out=",
+                            atomic_load(&statistics.bytes_out));
+    cursor = append_counter(cursor, " lines=",
+                            stats.lines + atomic_load(&statistics.lines));
+    cursor = append_counter(cursor, " escapes_parsed=", stats.sgr_escapes);
+    cursor = append_counter(cursor, " escapes_rejected=",
+                            stats.rejected_escapes);
+    cursor = append_counter(cursor, " prefixes=", stats.prefixes +
+                            atomic_load(&statistics.prefixes));
+    cursor = append_counter(cursor, " read_wait_ms=",
+                            atomic_load(&statistics.read_ns) / 1000000);
+    cursor = append_counter(cursor, " write_wait_ms=",
+                            atomic_load(&statistics.write_ns) / 1000000);
+    cursor = append_counter(cursor, " peak_buffered=",
+                            atomic_load(&statistics.peak_buffered));
+    *cursor++ = '\n';
+
+    if (write(statistics_fd, buffer, (size_t) (cursor - buffer))) {
+        // The statistics are informational, so errors are ignored.
+    }
+}
+
+/**
+ * Signal handler that writes a statistics report.
+ */
+static void handle_sigusr1(int unused)
+{
+    int saved_errno = errno;
+
+    (void) unused;
+    report_statistics();
+    errno = saved_errno;
+}
+
+/**
+ * Write data to a stdio stream. This is a redundansi_writer_ft implementation.
+ *
+ * Arguments:
+ * - context: A `FILE *`.
+ * - data: Data to write.
+ * - size: Number of bytes in "data".
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int write_to_file(void *context, const char *data, size_t size)
+{
+    if (fwrite(data, 1, size, context) != size) {
+        perror("fwrite");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Write all queued data to the file descriptor of a vector_writer_st.
+ *
+ * Arguments:
+ * - vw: The writer to flush.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int flush_vector_writer(vector_writer_st *vw)
+{
+    uint64_t start;
+    ssize_t written;
+
+    struct iovec *iov = vw->iov;
+    int iovcnt = vw->iovcnt;
+    uint64_t queued = 0;
+
+    for (int n = 0; n < iovcnt; n++) {
+        queued += iov[n].iov_len;
+    }
+
+    record_buffered(queued);
+
+    while (iovcnt > 0 && !vw->error) {
+        start = monotonic_ns();
+        written = writev(vw->fd, iov, iovcnt);
+        add_elapsed_ns(&statistics.write_ns, start);
+
+        // If the mapped input is truncated after some of it was queued, that
+        // part is gone. Like the rest of the file, it is treated as though the
+        // end of the file had been reached, and so is everything queued after
+        // it since it comes later in the input.
+        if (written == -1 && errno == EFAULT && input_mapping &&
+          (const char *) iov->iov_base >= input_mapping &&
+          (const char *) iov->iov_base < input_mapping + input_mapping_size) {
+            input_truncated = 1;
+            break;
+        } else if (written == -1) {
+            if (errno != EINTR) {
+                perror("writev");
+                vw->error = true;
+            }
+
+            continue;
+        }
+
+        atomic_fetch_add(&statistics.bytes_out, (uint64_t) written);
+
+        // Skip the vectors that were written completely, then adjust the first
+        // one that was written partially, if any.
+        while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= (size_t) written;
+        }
+    }
+
+    vw->iovcnt = 0;
+    vw->scratch_used = 0;
+    return vw->error ? -1 : 0;
+}
+
+/**
+ * Queue data in a vector_writer_st. Data inside the writer's stable region is
+ * referenced in place, and when it immediately follows the previously queued
+ * data, the two are combined into a single vector. Everything else is copied
+ * into the writer's scratch buffer. This is a redundansi_writer_ft
+ * implementation.
+ *
+ * Arguments:
+ * - context: A `vector_writer_st *`.
+ * - data: Data to write.
+ * - size: Number of bytes in "data".
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int write_to_vector(void *context, const char *data, size_t size)
+{
+    struct iovec *last;
+
+    vector_writer_st *vw = context;
+
+    bool stable = data >= vw->stable && data + size <= vw->stable_end;
+
+    // The writer is flushed before running out of vectors or scratch space.
+    // Checking both first ensures that a flush never discards scratch data
+    // that has not been queued yet.
+    if ((vw->iovcnt == ARRAY_LENGTH(vw->iov) ||
+      (!stable && size > sizeof(vw->scratch) - vw->scratch_used)) &&
+      flush_vector_writer(vw)) {
+        return -1;
+    }
+
+    if (!stable) {
+        // Data that cannot fit in the scratch buffer even when it is empty
+        // is written immediately.
+        if (size > sizeof(vw->scratch)) {
+            vw->iov[vw->iovcnt++] = (struct iovec) {(void *) data, size};
+            return flush_vector_writer(vw);
+        }
+
+        data = memcpy(vw->scratch + vw->scratch_used, data, size);
+        vw->scratch_used += size;
+    }
+
+    if (vw->iovcnt) {
+        last = &vw->iov[vw->iovcnt - 1];
+
+        if ((const char *) last->iov_base + last->iov_len == data) {
+            last->iov_len += size;
+            return 0;
+        }
+    }
+
+    vw->iov[vw->iovcnt++] = (struct iovec) {(void *) data, size};
+    return 0;
+}
+
+/**
+ * Determine the attributes in effect at the end of a chunk of input.
+ *
+ * Arguments:
+ * - incoming: Attributes in effect at the start of the chunk.
+ * - from_default: The attributes that would be in effect at the end of the
+ *   chunk if it started with the terminal defaults.
+ * - from_unset: The attributes that would be in effect at the end of the chunk
+ *   if it started with every flag set and every color set to COLOR_UNSET.
+ *
+ * Return: The attributes in effect at the end of the chunk.
+ */
+static redundansi_state_st compose_sgr_states(
+  const redundansi_state_st *incoming,
+  const redundansi_state_st *from_default,
+  const redundansi_state_st *from_unset)
+{
+    // A flag or color that differs between the two end states was never
+    // touched by the chunk, so it retains its incoming value. Everything else
+    // was explicitly set or cleared by the chunk.
+    uint16_t untouched = from_default->flags ^ from_unset->flags;
+
+    return (redundansi_state_st) {
+        .flags = (uint16_t) ((incoming->flags & untouched) |
+                             (from_default->flags & ~untouched)),
+        .fgcolor = from_default->fgcolor == from_unset->fgcolor ?
+            from_default->fgcolor : incoming->fgcolor,
+        .bgcolor = from_default->bgcolor == from_unset->bgcolor ?
+            from_default->bgcolor : incoming->bgcolor,
+        .ulcolor = from_default->ulcolor == from_unset->ulcolor ?
+            from_default->ulcolor : incoming->ulcolor,
+    };
+}
+
+/**
+ * Worker thread used by parallel_process. Chunks are claimed in order until
+ * none are left. In the first pass, each worker determines how a chunk changes
+ * the attribute state. In the second pass, chunks are rendered into memory
+ * buffers, but workers will not get more than PARALLEL_WINDOW_PER_JOB chunks
+ * per job ahead of the chunks that have already been written.
+ *
+ * Arguments:
+ * - context: Pointer to a parallel_st structure.
+ *
+ * Return: NULL
+ */
+static void *parallel_worker(void *context)
+{
+    chunk_st *chunk;
+    FILE *memstream;
+    redundansi_st rd;
+    redundansi_state_st shadow;
+    size_t index;
+
+    parallel_st *job = context;
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+
+        while (job->pass == 2 && job->next < job->chunk_count &&
+          job->next >= job->written + job->window) {
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
+
+        index = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (index >= job->chunk_count) {
+            return NULL;
+        }
+
+        chunk = &job->chunks[index];
+
+        if (job->pass == 1) {
+            shadow = (redundansi_state_st) {
+                .flags = UINT16_MAX,
+                .fgcolor = COLOR_UNSET,
+                .bgcolor = COLOR_UNSET,
+                .ulcolor = COLOR_UNSET,
+            };
+
+            redundansi_init(&rd);
+            rd.shadow = &shadow;
+            redundansi_feed(&rd, chunk->start, chunk->size, NULL, NULL);
+            chunk->from_default = rd.state;
+            chunk->from_unset = shadow;
+
+            if (rd.link_offset != UINT64_MAX) {
+                chunk->link = chunk->start + rd.link_offset;
+                chunk->link_size = rd.link_size;
+            }
+        } else {
+            redundansi_resume(&rd, &chunk->initial, index > 0);
+            rd.minify = job->minify;
+            rd.reset_at_end = job->reset_at_end &&
+              index == job->chunk_count - 1;
+
+            // The escape sequence was already validated in the first pass.
+            if (chunk->initial_link_size) {
+                redundansi_resume_link(&rd, chunk->initial_link,
+                                       chunk->initial_link_size, 0);
+            }
+
+            if (!(memstream = open_memstream(&chunk->output,
+              &chunk->output_size))) {
+                perror("open_memstream");
+                chunk->error = true;
+            } else if (redundansi_feed(&rd, chunk->start, chunk->size,
+              write_to_file, memstream) |
+              redundansi_finish(&rd, write_to_file, memstream) |
+              fclose(memstream)) {
+                chunk->error = true;
+            }
+
+            // Only the worker that rendered the last chunk writes to the
+            // stream, and it is not read until every worker has finished.
+            if (rd.deferred_length) {
+                memcpy(job->stream->deferred, rd.deferred,
+                       rd.deferred_length);
+                job->stream->deferred_length = rd.deferred_length;
+            }
+
+            add_stream_statistics(&rd.stats);
+
+            pthread_mutex_lock(&job->lock);
+            chunk->done = true;
+            pthread_cond_broadcast(&job->cond);
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+}
+
+/**
+ * Run parallel_worker in multiple threads and wait for all of them to finish.
+ * In the second pass, the calling thread writes the chunks to "dest" in order
+ * as they are completed.
+ *
+ * Arguments:
+ * - job: Shared state of the workers.
+ * - threads: Array used to store the thread identifiers.
+ * - jobs: Number of threads to start. This is also the size of "threads".
+ * - dest: Output file descriptor.
+ *
+ * Return: 0 if the pass was completed successfully and -1 otherwise.
+ */
+static int parallel_pass(parallel_st *job, pthread_t *threads, size_t jobs,
+  int dest)
+{
+    chunk_st *chunk;
+    size_t started;
+
+    int status = 0;
+    vector_writer_st vw = {.fd = dest};
+
+    job->next = 0;
+    job->written = 0;
+
+    for (started = 0; started < jobs; started++) {
+        if ((errno = pthread_create(&threads[started], NULL, parallel_worker,
+          job))) {
+            perror("pthread_create");
+            status = -1;
+            break;
+        }
+    }
+
+    // If no threads could be started, no chunks will ever be rendered, so
+    // there is nothing to wait for.
+    for (size_t n = 0; started && job->pass == 2 && n < job->chunk_count;
+      n++) {
+        chunk = &job->chunks[n];
+        pthread_mutex_lock(&job->lock);
+
+        while (!chunk->done) {
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
+
+        pthread_mutex_unlock(&job->lock);
+
+        if (chunk->error || write_to_vector(&vw, chunk->output,
+          chunk->output_size) || flush_vector_writer(&vw)) {
+            status = -1;
+        }
+
+        free(chunk->output);
+        chunk->output = NULL;
+
+        pthread_mutex_lock(&job->lock);
+        job->written++;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    while (started) {
+        pthread_join(threads[--started], NULL);
+    }
+
+    return status;
+}
+
+/**
+ * Process input with multiple threads. The input is split into chunks at
+ * newlines, and since the escape sequence parser is always reset at a
+ * newline, the only things carried between chunks are the attribute state
+ * and the hyperlink.
+ * First, each chunk is scanned independently to determine how it changes the
+ * attribute state. Then the states at the start of each chunk are derived by
+ * composing those changes in order, and finally the chunks are rendered in
+ * parallel and written sequentially.
+ *
+ * Arguments:
+ * - data: Input data.
+ * - size: Number of bytes in "data".
+ * - jobs: Number of threads to use.
+ * - rd: State of the stream. Only the "minify" and "reset_at_end" members are
+ *   used, and any escape sequences deferred at the end of the input are
+ *   stored in it.
+ * - dest: Output file descriptor.
+ *
+ * Return: 0 if the data was processed successfully and -1 otherwise.
+ */
+static int parallel_process(const char *data, size_t size, size_t jobs,
+  redundansi_st *rd, int dest)
+{
+    const char *boundary;
+    chunk_st *chunks;
+    const char *end;
+    parallel_st job;
+    size_t remaining;
+    pthread_t *threads;
+
+    size_t chunk_count = 0;
+    const char *cursor = data;
+    const char *link = NULL;
+    size_t link_size = 0;
+    redundansi_state_st state = {0};
+    int status = 0;
+
+    if (!(chunks = calloc(size / PARALLEL_CHUNK_SIZE + 1, sizeof(*chunks))) ||
+      !(threads = calloc(jobs, sizeof(*threads)))) {
+        perror("calloc");
+        free(chunks);
+        return -1;
+    }
+
+    for (end = data + size; cursor < end; cursor = boundary) {
+        remaining = (size_t) (end - cursor);
+
+        if (remaining <= PARALLEL_CHUNK_SIZE) {
+            boundary = end;
+        } else if ((boundary = memchr(cursor + PARALLEL_CHUNK_SIZE - 1, '\n',
+          remaining - PARALLEL_CHUNK_SIZE + 1))) {
+            boundary++;
+        } else {
+            boundary = end;
+        }
+
+        chunks[chunk_count].start = cursor;
+        chunks[chunk_count++].size = (size_t) (boundary - cursor);
+    }
+
+    job = (parallel_st) {
+        .chunk_count = chunk_count,
+        .chunks = chunks,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .minify = rd->minify,
+        .pass = 1,
+        .reset_at_end = rd->reset_at_end,
+        .stream = rd,
+        .window = jobs * PARALLEL_WINDOW_PER_JOB,
+    };
+
+    if (parallel_pass(&job, threads, jobs, dest)) {
+        status = -1;
+    } else {
+        for (size_t n = 0; n < chunk_count; n++) {
+            chunks[n].initial = state;
+            chunks[n].initial_link = link;
+            chunks[n].initial_link_size = link_size;
+            state = compose_sgr_states(&state, &chunks[n].from_default,
+                                       &chunks[n].from_unset);
+
+            if (chunks[n].link) {
+                link = chunks[n].link;
+                link_size = chunks[n].link_size;
+            }
+        }
+
+        job.pass = 2;
+        status = parallel_pass(&job, threads, jobs, dest);
+    }
+
+    free(chunks);
+    free(threads);
+    return status;
+}
+
+/**
+ * Signal handler that lets the processing of a mapped file continue when the
+ * file is truncated. Accessing a page of the mapping past the new end of the
+ * file raises SIGBUS, so that page and every page following it are replaced
+ * with zeros. Since NUL bytes are dropped from the output, the result is the
+ * same as if the end of the file had been reached. Any other SIGBUS is fatal.
+ *
+ * Arguments:
+ * - info: Information about the signal including the faulting address.
+ */
+static void handle_sigbus(int unused, siginfo_t *info, void *context)
+{
+    const char *page;
+
+    const char *address = info->si_addr;
+    const char *start = input_mapping;
+    size_t size = input_mapping_size;
+
+    (void) unused;
+    (void) context;
+
+    if (start && address >= start && address < start + size) {
+        page = start + (size_t) (address - start) / page_size * page_size;
+
+        if (mmap((void *) page, (size_t) (start + size - page), PROT_READ,
+          MAP_PRIVATE | MAP_FIXED, zero_fd, 0) != MAP_FAILED) {
+            input_truncated = 1;
+            return;
+        }
+    }
+
+    // Once the default action is restored, the faulting instruction raises
+    // the signal again when the handler returns.
+    signal(SIGBUS, SIG_DFL);
+}
+
+/**
+ * Map the regular file opened as standard input into memory. The first time
+ * this is called, a SIGBUS handler is installed to cope with the file being
+ * truncated while it is mapped, and if that is not possible, files are never
+ * mapped.
+ *
+ * Arguments:
+ * - size: Output pointer for the number of bytes from the current offset of
+ *   standard input to the end of the file.
+ * - mapping: Output pointer for the start of the mapping.
+ * - mapping_size: Output pointer for the size of the mapping.
+ *
+ * Return: A pointer to the data at the current offset of standard input or
+ * NULL if it is not a regular file or could not be mapped.
+ */
+static const char *map_stdin(size_t *size, void **mapping,
+  size_t *mapping_size)
+{
+    off_t offset;
+    struct sigaction sa;
+    struct stat status;
+
+    static bool handler_installed = false;
+    static bool handler_failed = false;
+
+    if (!handler_installed && !handler_failed) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_flags = SA_SIGINFO;
+        sa.sa_sigaction = handle_sigbus;
+        sigemptyset(&sa.sa_mask);
+        page_size = (size_t) sysconf(_SC_PAGESIZE);
+        handler_installed = page_size > 0 &&
+          (zero_fd = open("/dev/zero", O_RDONLY | O_CLOEXEC)) != -1 &&
+          !sigaction(SIGBUS, &sa, NULL);
+        handler_failed = !handler_installed;
+    }
+
+    if (handler_failed || fstat(STDIN_FILENO, &status) ||
+      !S_ISREG(status.st_mode) ||
+      (offset = lseek(STDIN_FILENO, 0, SEEK_CUR)) == -1 ||
+      offset >= status.st_size) {
+        return NULL;
+    }
+
+    *mapping_size = (size_t) status.st_size;
+    *mapping = mmap(NULL, *mapping_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO,
+                    0);
+
+    if (*mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    input_truncated = 0;
+    input_mapping_size = *mapping_size;
+    input_mapping = *mapping;
+    *size = (size_t) (status.st_size - offset);
+    return (const char *) *mapping + offset;
+}
+
+/**
+ * Parse a positive integer from a command line argument.
+ *
+ * Arguments:
+ * - text: Text to parse.
+ * - max: Largest acceptable value.
+ * - result: Output pointer for the parsed value.
+ *
+ * Return: 0 if the text represents an integer from 1 to "max" and -1
+ * otherwise.
+ */
+static int strtocount(const char *text, unsigned long long max,
+  unsigned long long *result)
+{
+    char *endptr;
+
+    errno = 0;
+    *result = strtoull(text, &endptr, 10);
+
+    if (errno || endptr == text || *endptr || text[0] == '-' ||
+      *result < 1 || *result > max) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parse the first lines of a block of input without writing any output.
+ *
+ * Arguments:
+ * - rd: State of the stream being processed.
+ * - data: Input data.
+ * - size: Number of bytes in "data".
+ * - lines: The total number of lines that should have been read from the
+ *   stream once this function returns.
+ *
+ * Return: The number of bytes that were consumed.
+ */
+static size_t skip_lines(redundansi_st *rd, const char *data, size_t size,
+  uint64_t lines)
+{
+    const char *newline;
+
+    const char *cursor = data;
+    const char *end = data + size;
+    uint64_t remaining = rd->lines < lines ? lines - rd->lines : 0;
+
+    for (; remaining; remaining--) {
+        if (!(newline = memchr(cursor, '\n', (size_t) (end - cursor)))) {
+            cursor = end;
+            break;
+        }
+
+        cursor = newline + 1;
+    }
+
+    redundansi_feed(rd, data, (size_t) (cursor - data), NULL, NULL);
+    return (size_t) (cursor - data);
+}
+
+/**
+ * Wait until one of the indices of a ring buffer no longer has a particular
+ * value.
+ *
+ * Arguments:
+ * - ring
+ * - index: Either the "head" or "tail" member of the ring.
+ * - value: The value that index currently has.
+ */
+static void ring_wait(ring_st *ring, atomic_size_t *index, size_t value)
+{
+    if (atomic_load(index) != value) {
+        return;
+    }
+
+    // The flag is raised before checking the index again, and ring_advance
+    // updates the index before checking the flag, so the sequentially
+    // consistent ordering of the operations ensures a wakeup cannot be missed.
+    pthread_mutex_lock(&ring->lock);
+
+    while (atomic_store(&ring->sleeping, true), atomic_load(index) == value) {
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * Increment one of the indices of a ring buffer, and wake the other thread if
+ * it is waiting.
+ *
+ * Arguments:
+ * - ring
+ * - index: Either the "head" or "tail" member of the ring.
+ */
+static void ring_advance(ring_st *ring, atomic_size_t *index)
+{
+    atomic_fetch_add(index, 1);
+
+    if (atomic_load(&ring->sleeping)) {
+        pthread_mutex_lock(&ring->lock);
+        atomic_store(&ring->sleeping, false);
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+/**
+ * Get the next empty slot of a ring buffer, waiting for one if the ring is
+ * full. This must only be called by the producer.
+ *
+ * Arguments:
+ * - ring
+ *
+ * Return: A slot that can be filled then published with ring_advance on the
+ * "head" member.
+ */
+static ring_slot_st *ring_next_empty(ring_st *ring)
+{
+    size_t head = atomic_load(&ring->head);
+
+    ring_wait(ring, &ring->tail, head - RING_SLOTS);
+    return &ring->slots[head % RING_SLOTS];
+}
+
+/**
+ * Get the next filled slot of a ring buffer, waiting for one if the ring is
+ * empty. This must only be called by the consumer.
+ *
+ * Arguments:
+ * - ring
  *
- * Return: The number of members in the array.
+ * Return: A slot that must be released with ring_advance on the "tail"
+ * member once it is no longer needed.
  */
-#define ARRAY_LENGTH(array) (sizeof(array) / sizeof((array)[0]))
+static ring_slot_st *ring_next_full(ring_st *ring)
+{
+    size_t tail = atomic_load(&ring->tail);
+
+    ring_wait(ring, &ring->head, tail);
+    return &ring->slots[tail % RING_SLOTS];
+}
 
 /**
- * Exit status to indicate the command the child process encountered an
- * unspecified error.
+ * Thread used by the pipelined mode to read the input into a ring buffer.
+ *
+ * Arguments:
+ * - context: Pointer to a pipeline_st structure.
+ *
+ * Return: NULL
  */
-#define EXIT_CHILD_FAILURE 126
+static void *pipeline_reader(void *context)
+{
+    ssize_t bytes_read;
+    ring_slot_st *slot;
+    uint64_t start;
+
+    pipeline_st *pipeline = context;
+
+    do {
+        slot = ring_next_empty(&pipeline->input);
+        start = monotonic_ns();
+
+        while ((bytes_read = read(pipeline->infd, slot->data,
+          sizeof(slot->data))) == -1 && errno == EINTR);
+
+        add_elapsed_ns(&statistics.read_ns, start);
+
+        if (bytes_read == -1) {
+            perror("read");
+            atomic_store(&pipeline->read_error, true);
+            bytes_read = 0;
+        }
+
+        slot->size = (size_t) bytes_read;
+        record_buffered(atomic_fetch_add(&pipeline->buffered, slot->size) +
+                        slot->size);
+        ring_advance(&pipeline->input, &pipeline->input.head);
+    } while (bytes_read);
+
+    return NULL;
+}
 
 /**
- * Exit status to indicate the command the child process tried to execute was
- * not found.
+ * Thread used by the pipelined mode to write the contents of a ring buffer to
+ * the output. After a write fails, the remaining data is discarded so the
+ * processing thread never blocks on a full ring.
+ *
+ * Arguments:
+ * - context: Pointer to a pipeline_st structure.
+ *
+ * Return: NULL
  */
-#define EXIT_EXEC_ENOENT 127
+static void *pipeline_writer(void *context)
+{
+    ring_slot_st *slot;
+    size_t size;
+    uint64_t start;
+    ssize_t written;
+
+    pipeline_st *pipeline = context;
+
+    do {
+        slot = ring_next_full(&pipeline->output);
+
+        for (size = 0; size < slot->size &&
+          !atomic_load(&pipeline->write_error); size += (size_t) written) {
+            start = monotonic_ns();
+            written = write(pipeline->outfd, slot->data + size,
+                            slot->size - size);
+            add_elapsed_ns(&statistics.write_ns, start);
+
+            if (written > 0) {
+                atomic_fetch_add(&statistics.bytes_out, (uint64_t) written);
+            } else if (written == -1 && errno == EINTR) {
+                written = 0;
+            } else if (written == -1) {
+                perror("write");
+                atomic_store(&pipeline->write_error, true);
+            }
+        }
+
+        size = slot->size;
+        atomic_fetch_sub(&pipeline->buffered, size);
+        ring_advance(&pipeline->output, &pipeline->output.tail);
+    } while (size);
+
+    return NULL;
+}
 
 /**
- * Exit status to indicate one or more I/O errors were encountered while
- * reading input or writing output.
+ * Publish the output slot being filled by the processing thread, if any.
+ *
+ * Arguments:
+ * - pipeline
  */
-#define EXIT_IO_ERROR 2
+static void publish_pending_output(pipeline_st *pipeline)
+{
+    size_t size;
+
+    if (pipeline->pending) {
+        size = pipeline->pending->size;
+        record_buffered(atomic_fetch_add(&pipeline->buffered, size) + size);
+        pipeline->pending = NULL;
+        ring_advance(&pipeline->output, &pipeline->output.head);
+    }
+}
 
 /**
- * Structure representing the parameters in an SGR escape sequence for a single
- * attribute.
+ * Queue data in the output ring buffer of a pipeline_st. This is a
+ * redundansi_writer_ft implementation.
+ *
+ * Arguments:
+ * - context: A `pipeline_st *`.
+ * - data: Data to write.
+ * - size: Number of bytes in "data".
+ *
+ * Return: 0 on success and -1 if the writer thread has failed.
  */
-typedef struct sgr_parameters_st {
-    /**
-     * The number of parameters in the SGR attribute specification.
-     */
+static int write_to_ring(void *context, const char *data, size_t size)
+{
     size_t count;
-    /**
-     * The numeric parameters of the SGR attribute specification. The number of
-     * defined values is specified in the "count" member, and the maximum
-     * number of parameters is 5 to accommodate the longest, valid single
-     * attribute SGR sequences ("\033[38;..." and "\033[48;..." with RGB
-     * colors).
-     */
-    int parameters[5];
-} sgr_parameters_st;
+
+    pipeline_st *pipeline = context;
+
+    while (size) {
+        if (!pipeline->pending) {
+            pipeline->pending = ring_next_empty(&pipeline->output);
+            pipeline->pending->size = 0;
+        }
+
+        count = sizeof(pipeline->pending->data) - pipeline->pending->size;
+        count = count < size ? count : size;
+        memcpy(pipeline->pending->data + pipeline->pending->size, data, count);
+        pipeline->pending->size += count;
+        data += count;
+        size -= count;
+
+        if (pipeline->pending->size == sizeof(pipeline->pending->data)) {
+            publish_pending_output(pipeline);
+        }
+    }
+
+    return atomic_load(&pipeline->write_error) ? -1 : 0;
+}
 
 /**
- * Generate an escape sequence string from an sgr_parameters_st structure.
+ * Process a stream with separate threads reading the input and writing the
+ * output so the processing overlaps with I/O. The threads exchange blocks of
+ * data with the processing thread using ring buffers.
  *
  * Arguments:
- * - sgr: An sgr_parameters_st representing an attribute specification.
+ * - rd: State of the stream being processed.
+ * - from_line: Number of the first line to write. This is 0 to write every
+ *   line.
+ * - infd: Input file descriptor.
+ * - outfd: Output file descriptor.
  *
- * Return: An ANSI escape sequence. This value points to a static buffer that
- * will be overwritten by subsequent calls to this function.
+ * Return: 0 if the stream was processed successfully and -1 otherwise.
  */
-static char* sgr2str(sgr_parameters_st *sgr)
+static int pipeline_process(redundansi_st *rd, uint64_t from_line, int infd,
+  int outfd)
 {
-    static char buffer[32];
-    ssize_t length;
+    size_t consumed;
+    pipeline_st pipeline;
+    pthread_t reader;
+    ring_slot_st *slot;
+    ring_slot_st *slots;
+    pthread_t writer;
+
+    int status = 0;
+
+    if (!(slots = calloc(RING_SLOTS * 2, sizeof(*slots)))) {
+        perror("calloc");
+        return -1;
+    }
+
+    pipeline = (pipeline_st) {
+        .infd = infd,
+        .input = {
+            .cond = PTHREAD_COND_INITIALIZER,
+            .lock = PTHREAD_MUTEX_INITIALIZER,
+            .slots = slots,
+        },
+        .outfd = outfd,
+        .output = {
+            .cond = PTHREAD_COND_INITIALIZER,
+            .lock = PTHREAD_MUTEX_INITIALIZER,
+            .slots = slots + RING_SLOTS,
+        },
+    };
+
+    if ((errno = pthread_create(&reader, NULL, pipeline_reader, &pipeline))) {
+        perror("pthread_create");
+        free(slots);
+        return -1;
+    }
 
-    if (sgr->count) {
-        length = sprintf(buffer, "\033[%d", sgr->parameters[0]);
+    if ((errno = pthread_create(&writer, NULL, pipeline_writer, &pipeline))) {
+        perror("pthread_create");
 
-        for (size_t n = 1; n < sgr->count; n++) {
-            length += sprintf(buffer + length, ";%d", sgr->parameters[n]);
+        // The reader thread is allowed to finish by draining the input.
+        while (ring_next_full(&pipeline.input)->size) {
+            ring_advance(&pipeline.input, &pipeline.input.tail);
         }
 
-        strcpy(buffer + length, "m");
+        pthread_join(reader, NULL);
+        free(slots);
+        return -1;
+    }
+
+    while ((slot = ring_next_full(&pipeline.input))->size) {
+        consumed = from_line ?
+            skip_lines(rd, slot->data, slot->size, from_line - 1) : 0;
+
+        if (redundansi_feed(rd, slot->data + consumed, slot->size - consumed,
+          write_to_ring, &pipeline)) {
+            status = -1;
+        }
+
+        atomic_fetch_sub(&pipeline.buffered, slot->size);
+        ring_advance(&pipeline.input, &pipeline.input.tail);
+
+        // Output is handed to the writer after every block of input so data
+        // that trickles in is not delayed until a slot has been filled.
+        publish_pending_output(&pipeline);
+    }
+
+    if (redundansi_finish(rd, write_to_ring, &pipeline)) {
+        status = -1;
+    }
+
+    publish_pending_output(&pipeline);
+
+    // An empty slot tells the writer thread there is no more data.
+    ring_next_empty(&pipeline.output)->size = 0;
+    ring_advance(&pipeline.output, &pipeline.output.head);
+
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    free(slots);
+
+    if (atomic_load(&pipeline.read_error) ||
+      atomic_load(&pipeline.write_error)) {
+        status = -1;
+    }
+
+    return status;
+}
+
+/**
+ * Find the checkpoint in an index file closest to a line in the file opened
+ * as standard input. Diagnostic messages are displayed for any errors.
+ *
+ * Arguments:
+ * - path: Path of the index file.
+ * - line: Number of lines preceding the position being sought.
+ * - checkpoint: Output pointer for the checkpoint. This will represent the
+ *   beginning of the file when there is no suitable checkpoint.
+ *
+ * Return: 0 if the index was usable and -1 otherwise.
+ */
+static int find_checkpoint(const char *path, uint64_t line,
+  redundansi_checkpoint_st *checkpoint)
+{
+    int fd;
+    redundansi_index_header_st header;
+    struct stat status;
+
+    int result = -1;
+
+    *checkpoint = (redundansi_checkpoint_st) {0};
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        perror(path);
+        return -1;
+    }
+
+    if (redundansi_index_read_header(fd, &header) ||
+      redundansi_index_lookup(fd, &header, line, checkpoint)) {
+        perror(path);
+    } else if (fstat(STDIN_FILENO, &status) || !S_ISREG(status.st_mode)) {
+        fprintf(stderr, "%s: input is not a regular file\n", path);
+    } else if (header.source_size != (uint64_t) status.st_size ||
+      header.source_mtime != (int64_t) status.st_mtime) {
+        fprintf(stderr, "%s: index is out of date\n", path);
     } else {
-        buffer[0] = '\0';
+        result = 0;
     }
 
-    return buffer;
+    if (result) {
+        *checkpoint = (redundansi_checkpoint_st) {0};
+    }
+
+    close(fd);
+    return result;
 }
 
 /**
- * Reset the contents of an sgr_parameters_st structure.
+ * Create an index file for the data read from standard input.
  *
  * Arguments:
- * - parameters: An sgr_parameters_st structure.
+ * - path: Path of the index file.
+ * - interval: Number of lines between checkpoints.
+ *
+ * Return: The opened index file or NULL if it could not be created. A
+ * diagnostic message is displayed for any errors.
  */
-static void clear_parameters(sgr_parameters_st *sgr)
+static FILE *create_index(const char *path, uint64_t interval)
 {
-    sgr->count = 0;
+    FILE *file;
+    struct stat status;
+
+    redundansi_index_header_st header = {.interval = interval};
+
+    if (!fstat(STDIN_FILENO, &status) && S_ISREG(status.st_mode)) {
+        header.source_size = (uint64_t) status.st_size;
+        header.source_mtime = (int64_t) status.st_mtime;
+    }
+
+    if (!(file = fopen(path, "w"))) {
+        perror(path);
+        return NULL;
+    }
+
+    if (redundansi_index_write_header(file, &header)) {
+        perror(path);
+        fclose(file);
+        return NULL;
+    }
+
+    return file;
 }
 
 /**
- * Parse an SGR escape sequence.
+ * Process the data read from standard input. Regular files are mapped into
+ * memory and may be processed in parallel while anything else is read in
+ * blocks.
  *
  * Arguments:
- * - escape: An SGR escape sequence. All parameters must be explicit for this
- *   function to parse the escape sequence.
+ * - rd: State of the stream. When the stream was resumed at a checkpoint,
+ *   "rd->offset" is the position in the input where processing starts.
+ * - from_line: Line number of the first line to write or 0 to write every
+ *   line.
+ * - jobs: Maximum number of threads to use for a regular file. Parallel
+ *   processing is only used when the stream starts at the beginning of the
+ *   input, every line is written and no index is being created.
+ * - pipeline: Indicates whether input that is not a regular file should be
+ *   read and written in separate threads.
+ * - dest: Output file descriptor.
  *
- * Return: A `NULL`-terminated array of sgr_parameters_st pointers with each
- * representing a terminal attribute specification. The returned array and its
- * members use statically allocated memory that will be overwritten by
- * subsequent calls to this function.
+ * Return: 0 if the input was processed successfully and -1 otherwise.
  */
-static sgr_parameters_st **parse_sgr_escape(char* escape)
+static int process_input(redundansi_st *rd, uint64_t from_line, size_t jobs,
+  bool pipeline, int dest)
 {
-    static sgr_parameters_st attributes[128];
-    static sgr_parameters_st *results[ARRAY_LENGTH(attributes) + 1];
-    int value;
+    size_t bytes_read;
+    size_t consumed;
+    const char *input;
+    char readbuf[65536];
+    size_t size;
+    uint64_t start;
+    vector_writer_st vw;
 
-    size_t attribute_count = 0;
-    size_t consume = 0;
-    sgr_parameters_st *last = NULL;
+    void *mapping = NULL;
+    size_t mapping_size = 0;
+    int status = 0;
 
-    do {
-        // Advance to the next number.
-        for (; *escape && (*escape < '0' || *escape > '9'); escape++);
-
-        if (consume == 0) {
-            attributes[attribute_count].count = 0;
-            last = &attributes[attribute_count];
-            results[attribute_count++] = last;
-        } else if (last->count >= ARRAY_LENGTH(attributes)) {
-            break;
+    if ((input = map_stdin(&size, &mapping, &mapping_size))) {
+        if (jobs > 1 && !rd->offset && !rd->checkpoint && !from_line) {
+            // The chunks are rendered with streams of their own, so anything
+            // deferred at the end of the previous stream is written first.
+            vw = (vector_writer_st) {.fd = dest};
+
+            if (redundansi_write_deferred(rd, write_to_vector, &vw) ||
+              flush_vector_writer(&vw) ||
+              parallel_process(input, size, jobs, rd, dest)) {
+                status = -1;
+            }
+        } else if (rd->offset > size) {
+            fputs("Index checkpoint is beyond the end of the input\n", stderr);
+            status = -1;
         } else {
-            consume--;
-        }
+            input += rd->offset;
+            size -= rd->offset;
+            consumed = from_line ? skip_lines(rd, input, size, from_line - 1) :
+                0;
+            input += consumed;
+            size -= consumed;
 
-        last->parameters[last->count++] = (
-            value = (int) strtol(escape, &escape, 10)
-        );
+            // Everything except the attribute prefixes is written straight
+            // from the mapping.
+            vw = (vector_writer_st) {
+                .fd = dest,
+                .stable = mapping,
+                .stable_end = (const char *) mapping + mapping_size,
+            };
 
-        if (last->count == 1 && (value == 38 || value == 48)) {
-            consume++;
-        } else if ((last->parameters[0] == 38 || last->parameters[0] == 48) &&
-          last->count == 2) {
-            if (last->parameters[1] == 2) {
-                consume += 3;
-            } else if (last->parameters[1] == 5) {
-                consume += 1;
+            if (redundansi_feed(rd, input, size, write_to_vector, &vw) ||
+              redundansi_finish(rd, write_to_vector, &vw) ||
+              flush_vector_writer(&vw)) {
+                status = -1;
             }
         }
-    } while (*escape && *escape != 'm');
 
-    results[attribute_count] = NULL;
-    return results;
+        // Like the read loop, this leaves standard input at the end of the
+        // data that was consumed, which is the end of the file if it was
+        // truncated.
+        if (lseek(STDIN_FILENO, input_truncated ? 0 : (off_t) mapping_size,
+          input_truncated ? SEEK_END : SEEK_SET) == -1) {
+            perror("lseek");
+            status = -1;
+        }
+
+        input_mapping = NULL;
+        munmap(mapping, mapping_size);
+        return status;
+    }
+
+    if (rd->offset && fseeko(stdin, (off_t) rd->offset, SEEK_CUR)) {
+        perror("fseeko");
+        return -1;
+    }
+
+    if (pipeline) {
+        return pipeline_process(rd, from_line, STDIN_FILENO, dest);
+    }
+
+    // The output for each block of input is written with a single writev(2)
+    // call that references the spans in the read buffer directly, so the
+    // buffer is treated as stable until the writer is flushed.
+    vw = (vector_writer_st) {
+        .fd = dest,
+        .stable = readbuf,
+        .stable_end = readbuf + sizeof(readbuf),
+    };
+
+    while (1) {
+        start = monotonic_ns();
+        bytes_read = fread(readbuf, 1, sizeof(readbuf), stdin);
+        add_elapsed_ns(&statistics.read_ns, start);
+
+        if (!bytes_read) {
+            break;
+        }
+
+        consumed = from_line ?
+            skip_lines(rd, readbuf, bytes_read, from_line - 1) : 0;
+
+        if (redundansi_feed(rd, readbuf + consumed, bytes_read - consumed,
+          write_to_vector, &vw) || flush_vector_writer(&vw)) {
+            status = -1;
+        }
+    }
+
+    if (redundansi_finish(rd, write_to_vector, &vw) ||
+      flush_vector_writer(&vw) || ferror(stdin)) {
+        status = -1;
+    }
+
+    return status;
+}
+
+/**
+ * Write a header in the style of head(1) that introduces the contents of a
+ * file. Any escape sequences deferred at the end of the previous file are
+ * written first.
+ *
+ * Arguments:
+ * - rd: State of the stream used to process the files.
+ * - path: Path of the file.
+ * - separate: When this is true, the header is preceded by a blank line to
+ *   separate it from the contents of the previous file.
+ * - dest: Output file descriptor.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int write_header(redundansi_st *rd, const char *path, bool separate,
+  int dest)
+{
+    vector_writer_st vw = {.fd = dest};
+
+    if (redundansi_write_deferred(rd, write_to_vector, &vw) ||
+      (separate && write_to_vector(&vw, "\n", 1)) ||
+      write_to_vector(&vw, "==> ", 4) ||
+      write_to_vector(&vw, path, strlen(path)) ||
+      write_to_vector(&vw, " <==\n", 5)) {
+        return -1;
+    }
+
+    return flush_vector_writer(&vw);
+}
+
+/**
+ * Display application usage information.
+ *
+ * Arguments:
+ * - self: Name or path of compiled executable.
+ */
+static void usage(const char *self)
+{
+    printf(
+        "Usage: %s [-mp] [-j JOBS] [-i INDEX [-I LINES] [-l LINE]] "
+        "[COMMAND [ARGUMENT]...]\n"
+        "       %s -f [-Hmp] [-j JOBS] FILE... [-- COMMAND [ARGUMENT]...]\n"
+        "\n"
+        "Generate explicit, redundant SGR escape sequences at the start of "
+        "every line\nread from standard input so attributes are rendered "
+        "the same way by pagers\nand terminals. When a command is given, "
+        "the output is piped into it.\n"
+        "\n"
+        "Options:\n"
+        "  -f, --files\n"
+        "           Read the files named by the operands preceding \"--\"\n"
+        "           instead of standard input. Attributes and hyperlinks are\n"
+        "           reset at the end of each file, so they do not carry over\n"
+        "           into the next one. The output of every file is piped\n"
+        "           into the same command.\n"
+        "  -H, --headers\n"
+        "           When reading files with \"-f\", write a header with the\n"
+        "           name of each file before its contents.\n"
+        "  -h, --help\n"
+        "           Show this text and exit.\n"
+        "  -I, --index-interval LINES\n"
+        "           Number of lines between the checkpoints in an index\n"
+        "           file. This defaults to %d.\n"
+        "  -i, --index INDEX\n"
+        "           Write an index file containing checkpoints with the byte\n"
+        "           offset and attributes of the input at regular line\n"
+        "           intervals. When \"-l\" is also used, the index is read\n"
+        "           instead, and the input is processed starting from the\n"
+        "           closest checkpoint. Since an index is only valid for the\n"
+        "           file it was generated from, the size and modification\n"
+        "           time of the input must match the ones recorded when the\n"
+        "           index was created.\n"
+        "  -j JOBS  Split input from regular files into chunks that are\n"
+        "           processed in parallel using the given number of\n"
+        "           threads. This option has no effect when \"-i\" or \"-l\"\n"
+        "           is used.\n"
+        "  -l, --from-line LINE\n"
+        "           Only write lines starting from the given line number.\n"
+        "           Attributes set by the preceding lines are still applied\n"
+        "           to the first line. Without an index, all of the\n"
+        "           preceding lines must be parsed.\n"
+        "  -m, --minify\n"
+        "           Drop the SGR escape sequences in the input, and instead\n"
+        "           write only the net change in attributes before printable\n"
+        "           text and newlines. Redundant and overwritten sequences\n"
+        "           are omitted from the output. Sequences that may leave\n"
+        "           attributes this program does not track in effect, like\n"
+        "           bright colors, are written as-is.\n"
+        "  -p, --pipeline\n"
+        "           Read the input and write the output in separate threads\n"
+        "           so processing overlaps with I/O. This option has no\n"
+        "           effect when the input is a regular file.\n"
+        "  --stats[=FD]\n"
+        "           Write statistics to the given file descriptor, standard\n"
+        "           error by default, once the input has been processed and\n"
+        "           whenever SIGUSR1 is received: bytes read and written,\n"
+        "           lines, SGR sequences parsed, escape sequences that were\n"
+        "           rejected because they were malformed or neither SGR\n"
+        "           sequences nor hyperlinks, attribute prefixes written,\n"
+        "           milliseconds spent waiting for input and for output to\n"
+        "           be written and the peak number of bytes buffered by this\n"
+        "           program.\n"
+        ,
+        self,
+        self,
+        DEFAULT_INDEX_INTERVAL
+    );
 }
 
 /**
@@ -192,51 +3375,174 @@ static void handle_sigchld(int unused)
 
 int main(int argc, char **argv)
 {
-    char byte;
-    size_t bytes_read;
+    redundansi_checkpoint_st checkpoint;
     int child_status;
-    char escape[32];
-    int first;
-    char readbuf[65536];
-    sgr_parameters_st *parameters;
+    int fd;
+    off_t input_start;
+    char link[REDUNDANSI_LINK_MAX];
+    int option;
     int pipefds[2];
-    char previous_byte;
-    sgr_parameters_st **seqs;
+    redundansi_st rd;
+    struct sigaction sa;
     int signum;
-    char writebuf[1024];
+    unsigned long long value;
+
+    static const struct option long_options[] = {
+        {"files", no_argument, NULL, 'f'},
+        {"from-line", required_argument, NULL, 'l'},
+        {"headers", no_argument, NULL, 'H'},
+        {"help", no_argument, NULL, 'h'},
+        {"index", required_argument, NULL, 'i'},
+        {"index-interval", required_argument, NULL, 'I'},
+        {"minify", no_argument, NULL, 'm'},
+        {"pipeline", no_argument, NULL, 'p'},
+        {"stats", optional_argument, NULL, STATS_OPTION},
+        {NULL, 0, NULL, 0},
+    };
 
     pid_t child = 0;
     int child_kill_signal = 0;
-    FILE *destfile = stdout;
-    size_t escapelen = 0;
+    int destfd = STDOUT_FILENO;
     int exit_code = EXIT_SUCCESS;
-    bool inside_sgr_escape_sequence = false;
+    size_t file_count = 0;
+    char **files = NULL;
+    uint64_t from_line = 0;
+    bool header_written = false;
+    bool headers = false;
+    FILE *index_file = NULL;
+    uint64_t index_interval = DEFAULT_INDEX_INTERVAL;
+    const char *index_path = NULL;
+    size_t jobs = 1;
+    bool minify = false;
+    bool pipeline = false;
+    bool read_files = false;
+    bool unreadable_files = false;
     void (*original_sigchld_hanlder)(int) = NULL;
-    bool print_escapes = false;
-
-    // Last explicit SGR parameters encountered for each class of attributes.
-    sgr_parameters_st bgcolor = {0};
-    sgr_parameters_st blink = {0};
-    sgr_parameters_st bold = {0};
-    sgr_parameters_st faint = {0};
-    sgr_parameters_st fgcolor = {0};
-    sgr_parameters_st hidden = {0};
-    sgr_parameters_st italic = {0};
-    sgr_parameters_st reverse = {0};
-    sgr_parameters_st strike = {0};
-    sgr_parameters_st underline = {0};
-
-    if (argc >= 2 && !(strcmp(argv[1], "--help") && strcmp(argv[1], "-h") &&
-      strcmp(argv[1], "-V"))) {
-        printf("Usage: %s [COMMAND [ARGUMENT]...]", basename(argv[0]));
-        return EXIT_SUCCESS;
-    }
-
-    if (isatty(STDIN_FILENO)) {
+
+    while ((option = getopt_long(argc, argv, "+fHhI:i:j:l:mpV", long_options,
+      NULL)) != -1) {
+        switch (option) {
+          case 'f':
+            read_files = true;
+            break;
+
+          case 'H':
+            headers = true;
+            break;
+
+          case 'h':
+          case 'V':
+            usage(basename(argv[0]));
+            return EXIT_SUCCESS;
+
+          case 'I':
+            if (strtocount(optarg, UINT32_MAX, &value)) {
+                fprintf(stderr, "%s: invalid index interval\n", optarg);
+                return EXIT_FAILURE;
+            }
+
+            index_interval = value;
+            break;
+
+          case 'i':
+            index_path = optarg;
+            break;
+
+          case 'j':
+            if (strtocount(optarg, 1024, &value)) {
+                fprintf(stderr, "%s: invalid job count\n", optarg);
+                return EXIT_FAILURE;
+            }
+
+            jobs = (size_t) value;
+            break;
+
+          case 'l':
+            if (strtocount(optarg, UINT64_MAX, &value)) {
+                fprintf(stderr, "%s: invalid line number\n", optarg);
+                return EXIT_FAILURE;
+            }
+
+            from_line = value;
+            break;
+
+          case 'm':
+            minify = true;
+            break;
+
+          case 'p':
+            pipeline = true;
+            break;
+
+          case STATS_OPTION:
+            statistics_fd = STDERR_FILENO;
+
+            if (!optarg) {
+                break;
+            } else if (strtocount(optarg, INT_MAX, &value) ||
+              fcntl((int) value, F_GETFD) == -1) {
+                fprintf(stderr, "%s: invalid file descriptor\n", optarg);
+                return EXIT_FAILURE;
+            }
+
+            statistics_fd = (int) value;
+            break;
+
+          case '+':
+            // Using "+" to ensure POSIX-style argument parsing is a GNU
+            // extension, so an explicit check for "+" as a flag is added for
+            // other getopt(3) implementations.
+            fprintf(stderr, "%s: invalid option -- '%c'\n", argv[0], option);
+            return EXIT_FAILURE;
+
+          default:
+            return EXIT_FAILURE;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+    checkpoint = (redundansi_checkpoint_st) {0};
+
+    // When reading files, the command follows the file names and "--".
+    if (read_files) {
+        files = argv;
+
+        while (file_count < (size_t) argc && strcmp(files[file_count], "--")) {
+            file_count++;
+        }
+
+        argc -= (int) file_count;
+        argv += file_count;
+
+        if (argc > 0) {
+            argc--;
+            argv++;
+        }
+
+        if (!file_count) {
+            fputs("No files specified\n", stderr);
+            return EXIT_FAILURE;
+        } else if (index_path || from_line) {
+            fputs("\"-f\" cannot be used with \"-i\" or \"-l\"\n", stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // An unusable index is not fatal when reading since the lines can still
+    // be skipped by parsing them.
+    if (index_path && from_line) {
+        find_checkpoint(index_path, from_line - 1, &checkpoint);
+    } else if (index_path && !(index_file = create_index(index_path,
+      index_interval))) {
+        return EXIT_FAILURE;
+    }
+
+    if (!read_files && isatty(STDIN_FILENO)) {
         fputs("Awaiting input from TTY...\n", stderr);
     }
 
-    if (argc > 1) {
+    if (argc > 0) {
         if (pipe(pipefds)) {
             perror("pipe2");
             return EXIT_FAILURE;
@@ -259,7 +3565,6 @@ int main(int argc, char **argv)
                 _exit(1);
             }
 
-            argv++;
             execvp(argv[0], argv);
             perror(argv[0]);
             _exit(errno == ENOENT ? EXIT_EXEC_ENOENT : EXIT_CHILD_FAILURE);
@@ -273,170 +3578,121 @@ int main(int argc, char **argv)
                 return EXIT_FAILURE;
             }
 
-            if (!(destfile = fdopen(pipefds[1], "w"))) {
-                perror("fdopen");
-                signal(SIGCHLD, NULL);
-                kill(child, SIGHUP);
-                return EXIT_FAILURE;
-            }
+            destfd = pipefds[1];
+
+#ifdef F_SETPIPE_SZ
+            // A larger pipe lets more output be queued before the child has
+            // to be woken up. Failing to resize it is harmless.
+            fcntl(destfd, F_SETPIPE_SZ, CHILD_PIPE_CAPACITY);
+#endif
         }
     }
 
-    while ((bytes_read = fread(readbuf, 1, sizeof(readbuf), stdin))) {
-        for (size_t n = 0; n < bytes_read; n++) {
-            // Printing escapes after the last newline in the file can result
-            // in an extra, blank line being rendered by a pager, so we only
-            // print escapes after reading the next byte following a newline
-            // since we know at that stage that the newline was not end of the
-            // file.
-            if (print_escapes) {
-                strcpy(writebuf, sgr2str(&bgcolor));
-                strcat(writebuf, sgr2str(&blink));
-                strcat(writebuf, sgr2str(&bold));
-                strcat(writebuf, sgr2str(&faint));
-                strcat(writebuf, sgr2str(&fgcolor));
-                strcat(writebuf, sgr2str(&hidden));
-                strcat(writebuf, sgr2str(&italic));
-                strcat(writebuf, sgr2str(&reverse));
-                strcat(writebuf, sgr2str(&strike));
-                strcat(writebuf, sgr2str(&underline));
-
-                if (fputs(writebuf, destfile) == EOF) {
-                    exit_code = EXIT_IO_ERROR;
-                }
+    if (statistics_fd != -1) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_flags = SA_RESTART;
+        sa.sa_handler = handle_sigusr1;
 
-                print_escapes = false;
-            }
+        if (sigaction(SIGUSR1, &sa, NULL) == -1) {
+            perror("sigaction");
+            exit_code = EXIT_FAILURE;
+            goto done;
+        }
+    }
 
-            byte = readbuf[n];
-
-            if (!byte) {
-                // The terminal emulators I tested seem to just ignore NUL
-                // bytes inside of escape sequences. In Less, they seem to
-                // cause rendering issues, so we simply drop NUL bytes so the
-                // rendered text is the same regardless of whether or not it is
-                // fed to Less.
-                continue;
-            } else if (fputc(byte, destfile) == EOF) {
-                perror("fputc");
-                exit_code = EXIT_IO_ERROR;
-            }
+    redundansi_resume(&rd, &checkpoint.state, checkpoint.line > 0);
+    rd.lines = checkpoint.line;
+    rd.offset = checkpoint.offset;
+    rd.minify = minify;
+    rd.reset_at_end = file_count > 0;
+    statistics_stream = &rd;
 
-            if (byte == '\n') {
-                inside_sgr_escape_sequence = false;
-                escapelen = 0;
-                print_escapes = true;
-            } else if (byte == '\033') {
-                inside_sgr_escape_sequence = true;
-                escape[escapelen++] = byte;
-            } else if (inside_sgr_escape_sequence) {
-                if (escapelen >= sizeof(escape) - 1) {
-                    goto invalid_sgr_sequence;
-                }
+    // Checkpoints only record where the escape sequence for the hyperlink in
+    // effect is, so it is read back from the input. Like the other offsets in
+    // the checkpoint, it is relative to the position standard input started
+    // at while pread(2) uses absolute offsets.
+    if (checkpoint.link_size && (checkpoint.link_size > sizeof(link) ||
+      (input_start = lseek(STDIN_FILENO, 0, SEEK_CUR)) == -1 ||
+      pread(STDIN_FILENO, link, checkpoint.link_size,
+      input_start + (off_t) checkpoint.link_offset) !=
+      (ssize_t) checkpoint.link_size ||
+      redundansi_resume_link(&rd, link, checkpoint.link_size,
+      checkpoint.link_offset))) {
+        fputs("Unable to restore the hyperlink at the index checkpoint\n",
+              stderr);
+        exit_code = EXIT_IO_ERROR;
+        goto done;
+    }
 
-                // Per the ANSI spec, empty parameters are equivalent to 0.
-                previous_byte = escape[escapelen - 1];
+    if (index_file) {
+        rd.checkpoint = redundansi_index_write_checkpoint;
+        rd.checkpoint_context = index_file;
+        rd.checkpoint_interval = index_interval;
+    }
 
-                if ((previous_byte == '[' || previous_byte == ';') &&
-                  (byte == ';' || byte == 'm')) {
-                    escape[escapelen++] = '0';
+    if (!file_count && process_input(&rd, from_line, jobs, pipeline,
+      destfd)) {
+        exit_code = EXIT_IO_ERROR;
+    }
 
-                    if (escapelen >= sizeof(escape) - 1) {
-                        goto invalid_sgr_sequence;
-                    }
-                }
+    // Each file replaces standard input in turn. Since the stream is finished
+    // at the end of every file, no attributes are carried into the next one.
+    for (size_t n = 0; n < file_count; n++) {
+        if ((fd = open(files[n], O_RDONLY)) == -1) {
+            perror(files[n]);
+            unreadable_files = true;
+            continue;
+        } else if (fd != STDIN_FILENO) {
+            if (dup2(fd, STDIN_FILENO) == -1) {
+                perror("dup2");
+                close(fd);
+                exit_code = EXIT_IO_ERROR;
+                break;
+            }
 
-                escape[escapelen++] = byte;
-
-                if (byte == 'm' && escapelen > 2) {
-                    for (seqs = parse_sgr_escape(escape); *seqs; seqs++) {
-                        parameters = *seqs;
-                        first = parameters->parameters[0];
-
-                        if (first == 0) {
-                            clear_parameters(&bgcolor);
-                            clear_parameters(&blink);
-                            clear_parameters(&bold);
-                            clear_parameters(&faint);
-                            clear_parameters(&fgcolor);
-                            clear_parameters(&hidden);
-                            clear_parameters(&italic);
-                            clear_parameters(&reverse);
-                            clear_parameters(&strike);
-                            clear_parameters(&underline);
-                        } else if (first == 1) {
-                            bold = *parameters;
-                        } else if (first == 2) {
-                            faint = *parameters;
-                        } else if (first == 3) {
-                            italic = *parameters;
-                        } else if (first == 4) {
-                            underline = *parameters;
-                        } else if (first == 5 || first == 6) {
-                            blink = *parameters;
-                        } else if (first == 7) {
-                            reverse = *parameters;
-                        } else if (first == 8) {
-                            hidden = *parameters;
-                        } else if (first == 9) {
-                            strike = *parameters;
-                        } else if (first == 22) {
-                            clear_parameters(&faint);
-                            clear_parameters(&italic);
-                        } else if (first == 23) {
-                            clear_parameters(&italic);
-                        } else if (first == 24) {
-                            clear_parameters(&underline);
-                        } else if (first == 25) {
-                            clear_parameters(&blink);
-                        } else if (first == 27) {
-                            clear_parameters(&reverse);
-                        } else if (first == 28) {
-                            clear_parameters(&hidden);
-                        } else if (first == 29) {
-                            clear_parameters(&strike);
-                        } else if (first >= 30 && first <= 38) {
-                            fgcolor = *parameters;
-                        } else if (first == 39) {
-                            clear_parameters(&fgcolor);
-                        } else if (first >= 40 && first <= 48) {
-                            bgcolor = *parameters;
-                        } else if (first == 49) {
-                            clear_parameters(&bgcolor);
-                        }
-                    }
-                } else if (escapelen == 2 && byte == '[') {
-                    continue;
-                } else if (escapelen > 2) {
-                    if (byte == ';' || (byte >= '0' && byte <= '9')) {
-                        continue;
-                    }
-                }
+            close(fd);
+        }
 
-invalid_sgr_sequence:
-                inside_sgr_escape_sequence = false;
-                escapelen = 0;
-            }
+        clearerr(stdin);
+
+        if ((headers &&
+          write_header(&rd, files[n], header_written, destfd)) ||
+          process_input(&rd, 0, jobs, pipeline, destfd)) {
+            exit_code = EXIT_IO_ERROR;
         }
+
+        header_written = headers;
+    }
+
+done:
+    if (index_file && fclose(index_file) == EOF) {
+        perror(index_path);
+        exit_code = EXIT_IO_ERROR;
     }
 
     if (child) {
         signal(SIGCHLD, original_sigchld_hanlder);
     }
 
-    if (ferror(stdin)) {
+    if (close(destfd) && exit_code == 0) {
         exit_code = EXIT_IO_ERROR;
     }
 
-    if (fclose(destfile) == EOF && exit_code == 0) {
+    if (statistics_fd != -1) {
+        report_statistics();
+    }
+
+    if (child && exit_code) {
+        kill(child, (child_kill_signal = SIGHUP));
+    }
+
+    // Files that could not be opened do not interrupt the command, but they
+    // are still reflected in the exit status.
+    if (!exit_code && unreadable_files) {
         exit_code = EXIT_IO_ERROR;
     }
 
     if (child) {
-        if (exit_code) {
-            kill(child, (child_kill_signal = SIGHUP));
-        }
-
         while (1) {
             if (waitpid(child, &child_status, 0) == -1) {
                 perror("waitpid");
@@ -456,3 +3712,4 @@ invalid_sgr_sequence:
 
     return exit_code;
 }
+#endif
@@ -0,0 +1,353 @@
+/**
+ * RedundANSI Library
+ *
+ * Interface for applications that want to generate redundant SGR escape
+ * sequences in-process instead of piping data through the redundansi command.
+ * To use it, compile "redundansi.c" with "-DREDUNDANSI_NO_MAIN" and link the
+ * resulting object into the application. Each stream is processed by calling
+ * redundansi_init, passing the input to redundansi_feed in blocks of any size
+ * and calling redundansi_finish once the input has been exhausted.
+ *
+ * A stream can also report checkpoints at regular line intervals. These can be
+ * saved in an index file so a later invocation can use redundansi_resume to
+ * start processing the stream at a checkpoint instead of the beginning.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#ifndef REDUNDANSI_H
+#define REDUNDANSI_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Maximum length of the escape sequence generated from a redundansi_state_st
+ * excluding the null byte.
+ */
+#define REDUNDANSI_ESCAPE_MAX \
+    (sizeof("\033[1;2;3;4;5;7;8;9;38;2;255;255;255;48;2;255;255;255;" \
+            "58;2;255;255;255m") - 1)
+
+/**
+ * Maximum length of the OSC 8 escape sequence used to carry a hyperlink across
+ * lines. Hyperlinks that would exceed this are passed through as-is, but they
+ * are not repeated on subsequent lines.
+ */
+#define REDUNDANSI_LINK_MAX 2048
+
+/**
+ * Function used to write processed data.
+ *
+ * Arguments:
+ * - context: Opaque pointer supplied along with the function.
+ * - data: Data to write.
+ * - size: Number of bytes in "data".
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+typedef int (*redundansi_writer_ft)(void *context, const char *data,
+  size_t size);
+
+/**
+ * Compact representation of the attributes in effect at a point in a stream.
+ */
+typedef struct redundansi_state_st {
+    /**
+     * Packed foreground color.
+     */
+    uint32_t fgcolor;
+    /**
+     * Packed background color.
+     */
+    uint32_t bgcolor;
+    /**
+     * Packed underline color.
+     */
+    uint32_t ulcolor;
+    /**
+     * Bitmask of boolean attributes. Like the colors, the encoding is private
+     * to the implementation.
+     */
+    uint16_t flags;
+} redundansi_state_st;
+
+/**
+ * Position in a stream at the start of a line along with the attributes in
+ * effect at that point.
+ */
+typedef struct redundansi_checkpoint_st {
+    /**
+     * Number of lines preceding the checkpoint.
+     */
+    uint64_t line;
+    /**
+     * Offset of the checkpoint relative to the start of the stream.
+     */
+    uint64_t offset;
+    /**
+     * Attributes in effect at the checkpoint.
+     */
+    redundansi_state_st state;
+    /**
+     * Offset of the last OSC 8 escape sequence preceding the checkpoint.
+     * Hyperlinks can be much longer than the other attributes, so instead of
+     * storing the hyperlink itself, the sequence that set it is located with
+     * this and "link_size" so it can be passed to redundansi_resume_link.
+     */
+    uint64_t link_offset;
+    /**
+     * Number of bytes in the escape sequence at "link_offset" or 0 if no
+     * hyperlink has been set or cleared before the checkpoint.
+     */
+    uint16_t link_size;
+} redundansi_checkpoint_st;
+
+/**
+ * Function called whenever a stream reaches a checkpoint.
+ *
+ * Arguments:
+ * - context: Opaque pointer supplied along with the function.
+ * - checkpoint: Description of the checkpoint.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+typedef int (*redundansi_checkpoint_ft)(void *context,
+  const redundansi_checkpoint_st *checkpoint);
+
+/**
+ * Counters describing the data processed by a redundansi_st.
+ */
+typedef struct redundansi_stats_st {
+    /**
+     * Number of bytes passed to redundansi_feed.
+     */
+    uint64_t bytes;
+    /**
+     * Number of lines that have been read.
+     */
+    uint64_t lines;
+    /**
+     * Number of escape sequences that have been started.
+     */
+    uint64_t escapes;
+    /**
+     * Number of SGR escape sequences that have been applied to the
+     * attributes.
+     */
+    uint64_t sgr_escapes;
+    /**
+     * Number of escape sequences that were malformed or that were neither
+     * SGR sequences nor OSC 8 hyperlinks. These are dropped or written as-is
+     * without affecting the attributes.
+     */
+    uint64_t rejected_escapes;
+    /**
+     * Number of times attributes have been written, either as a line prefix
+     * or as a minified change.
+     */
+    uint64_t prefixes;
+} redundansi_stats_st;
+
+/**
+ * Metadata stored at the beginning of an index file.
+ */
+typedef struct redundansi_index_header_st {
+    /**
+     * Number of lines between checkpoints.
+     */
+    uint64_t interval;
+    /**
+     * Size of the indexed file or 0 if it is unknown.
+     */
+    uint64_t source_size;
+    /**
+     * Modification time of the indexed file as a Unix timestamp or 0 if it is
+     * unknown.
+     */
+    int64_t source_mtime;
+} redundansi_index_header_st;
+
+/**
+ * State of a stream being processed.
+ */
+typedef struct redundansi_st {
+    /**
+     * Attributes in effect at the current position in the input.
+     */
+    redundansi_state_st state;
+    /**
+     * When this is not NULL, the parameters of every SGR escape sequence are
+     * also applied to this state.
+     */
+    redundansi_state_st *shadow;
+    /**
+     * Current state of the escape sequence parser.
+     */
+    uint8_t parser;
+    /**
+     * Value of the SGR parameter currently being read.
+     */
+    int parameter;
+    /**
+     * Parameters of the SGR attribute specification currently being read.
+     */
+    int attribute[5];
+    /**
+     * Number of values in "attribute".
+     */
+    size_t attribute_length;
+    /**
+     * Attributes that will be in effect once the SGR escape sequence being
+     * read has been terminated.
+     */
+    redundansi_state_st pending;
+    /**
+     * Value "shadow" will be assigned once the SGR escape sequence being read
+     * has been terminated.
+     */
+    redundansi_state_st pending_shadow;
+    /**
+     * Contents of the OSC string being read or the first part of it when it is
+     * too long to be a tracked hyperlink.
+     */
+    char osc[REDUNDANSI_LINK_MAX - sizeof("\033]\033\\") + 1];
+    /**
+     * Number of bytes in the OSC string being read or SIZE_MAX if it was too
+     * long to fit in "osc".
+     */
+    size_t osc_length;
+    /**
+     * Offset of the OSC string being read relative to the start of the
+     * stream.
+     */
+    uint64_t osc_offset;
+    /**
+     * OSC 8 escape sequence that sets the hyperlink in effect at the current
+     * position in the input.
+     */
+    char link[REDUNDANSI_LINK_MAX];
+    /**
+     * Length of "link" which is 0 when no hyperlink is in effect.
+     */
+    size_t link_length;
+    /**
+     * Offset and size of the escape sequence in the input that last set or
+     * cleared the hyperlink. Refer to redundansi_checkpoint_st for details.
+     */
+    uint64_t link_offset;
+    uint16_t link_size;
+    /**
+     * Indicates whether the attributes should be emitted before the next
+     * byte.
+     */
+    bool print_escapes;
+    /**
+     * Indicates whether the attributes have changed since "prefix" was last
+     * rendered.
+     */
+    bool prefix_dirty;
+    /**
+     * Escape sequence that applies the current attributes.
+     */
+    char prefix[REDUNDANSI_ESCAPE_MAX + 1];
+    /**
+     * Length of "prefix".
+     */
+    size_t prefix_length;
+    /**
+     * Attributes the output is known to have when minifying.
+     */
+    redundansi_state_st emitted;
+    /**
+     * Indicates whether no printable text has been written since the last
+     * newline when minifying.
+     */
+    bool line_start;
+    /**
+     * Bytes of a potential SGR escape sequence that are held back when
+     * minifying.
+     */
+    char held[64];
+    /**
+     * Number of bytes in "held".
+     */
+    size_t held_length;
+    /**
+     * Indicates whether the escape sequence being read was too long to hold
+     * and is being written as-is instead.
+     */
+    bool held_overflow;
+    /**
+     * Number of lines that have been read.
+     */
+    uint64_t lines;
+    /**
+     * Number of bytes that have been read.
+     */
+    uint64_t offset;
+    /**
+     * Counters for the data that has been processed. Unlike the other
+     * members, these accumulate across streams since they are preserved by
+     * redundansi_finish.
+     */
+    redundansi_stats_st stats;
+    /**
+     * When this is true, SGR escape sequences from the input are dropped, and
+     * only the net change in attributes is written before printable text,
+     * newlines and the end of the input. Sequences that may leave attributes
+     * that are not tracked in effect are written as-is. Like the following
+     * three members, this may be set after the structure has been
+     * initialized, and it is preserved by redundansi_finish.
+     */
+    bool minify;
+    /**
+     * When this is true, redundansi_finish ends the output with the default
+     * attributes and closes any hyperlink left open by the input, so the
+     * output can be followed by unrelated data. If the input ends with a
+     * newline, the escape sequences are deferred instead since a line
+     * containing nothing else would be rendered as an extra, blank line by a
+     * pager. This is preserved by redundansi_finish.
+     */
+    bool reset_at_end;
+    /**
+     * Escape sequences deferred by redundansi_finish. They are written before
+     * the first byte of the next stream or by redundansi_write_deferred, and
+     * like the counters, they are preserved by redundansi_finish.
+     */
+    char deferred[sizeof("\033[m\033]8;;\033\\")];
+    /**
+     * Length of "deferred".
+     */
+    size_t deferred_length;
+    /**
+     * Function called after every "checkpoint_interval" lines. This may be
+     * NULL.
+     */
+    redundansi_checkpoint_ft checkpoint;
+    /**
+     * Argument passed to the checkpoint function.
+     */
+    void *checkpoint_context;
+    /**
+     * Number of lines between checkpoints.
+     */
+    uint64_t checkpoint_interval;
+} redundansi_st;
+
+void redundansi_init(redundansi_st *);
+void redundansi_resume(redundansi_st *, const redundansi_state_st *, bool);
+int redundansi_resume_link(redundansi_st *, const char *, size_t, uint64_t);
+int redundansi_feed(redundansi_st *, const char *, size_t,
+                    redundansi_writer_ft, void *);
+int redundansi_finish(redundansi_st *, redundansi_writer_ft, void *);
+int redundansi_write_deferred(redundansi_st *, redundansi_writer_ft,
+                             void *);
+int redundansi_index_write_header(FILE *, const redundansi_index_header_st *);
+int redundansi_index_write_checkpoint(void *,
+                                      const redundansi_checkpoint_st *);
+int redundansi_index_read_header(int, redundansi_index_header_st *);
+int redundansi_index_lookup(int, const redundansi_index_header_st *, uint64_t,
+                            redundansi_checkpoint_st *);
+#endif
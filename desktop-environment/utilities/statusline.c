@@ -10,19 +10,24 @@
  * for the Sun" (AKA "moontool") and Kevin Turner's Python port of the same
  * tool.
  *
- * Make: c99 -D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE -o $@ $? -lm
+ * Make: c99 -D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE -o $@ $? -lm -lpthread
  * Copyright: Eric Pruitt (https://www.codevat.com/)
  * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
  */
+#include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <libgen.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -30,23 +35,28 @@
 #include <time.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-static char *battery_indicator(const char *);
 static void delete_range(char *, size_t, size_t);
 static size_t dow_with_ordinal_dom(char *, size_t, struct tm *);
 static void gmt_to_utc(char *);
 static double mtime(const char *);
 static size_t load_indicators_from_file(char *, size_t, const char *,
                                         const char *);
-static size_t tzstrftime(char *, size_t, const char *, time_t, const char *);
 
 /**
  * Used to indicate whether updates should be paused.
  */
-static int pause_updates = 0;
+static volatile sig_atomic_t pause_updates = 0;
 
 /**
  * Get the number of members in a fixed-length array.
@@ -78,6 +88,81 @@ static int pause_updates = 0;
  */
 #define PAUSE_DURATION_SEC 1.5
 
+/**
+ * Seconds between refreshes of the battery indicator.
+ */
+#define BATTERY_REFRESH_SEC 5
+
+/**
+ * Seconds between refreshes of the battery indicator when power supply
+ * uevents are received. Not every driver emits an event when the capacity
+ * changes, so the battery is still polled occasionally.
+ */
+#define BATTERY_EVENT_REFRESH_SEC 60
+
+/**
+ * Most seconds the first line waits for the source worker to load the status
+ * file and the batteries.
+ */
+#define FIRST_SNAPSHOT_TIMEOUT_SEC 0.5
+
+/**
+ * Directory containing a subdirectory for every power supply on Linux.
+ */
+#define POWER_SUPPLY_DIRECTORY "/sys/class/power_supply"
+
+/**
+ * Most batteries and most external power supplies that are tracked. Any
+ * others are ignored.
+ */
+#define POWER_SUPPLY_LIMIT 8
+
+/**
+ * Time constant in seconds of the moving average used to smooth the charge
+ * and discharge rates of the batteries. Readings taken this far apart carry
+ * roughly 63% of the weight of the new one.
+ */
+#define POWER_RATE_SMOOTHING_SEC 120
+
+/**
+ * Estimated time remaining is only shown when it is less than this many
+ * hours. Longer estimates are usually an artifact of a nearly idle rate.
+ */
+#define POWER_ESTIMATE_LIMIT_HOURS 100
+
+/**
+ * Flags returned by "read_uevents" and "wait_for_tick" when a power supply
+ * changed and when one was added or removed respectively.
+ */
+#define UEVENT_POWER_SUPPLY 1
+#define UEVENT_POWER_SUPPLY_HOTPLUG 2
+
+/**
+ * Flags returned by "read_status_file_events" and "wait_for_tick" when the
+ * status file was replaced, written or removed and when the directory
+ * containing it can no longer be watched respectively.
+ */
+#define STATUS_FILE_CHANGED 4
+#define STATUS_FILE_UNWATCHED 8
+
+/**
+ * Directory containing the TZif files of named time zones when the TZDIR
+ * environment variable is unset.
+ */
+#define ZONEINFO_DIRECTORY "/usr/share/zoneinfo"
+
+/**
+ * TZif file describing the local time zone when the TZ environment variable
+ * is unset.
+ */
+#define LOCAL_TIME_ZONE_PATH "/etc/localtime"
+
+/**
+ * Largest TZif file that will be loaded. Files in the tz database are only a
+ * few kilobytes.
+ */
+#define TZIF_SIZE_LIMIT 262144
+
 /**
  * Identifiers for the named phases of the moon.
  */
@@ -94,210 +179,2491 @@ typedef enum {
 } moon_phase_et;
 
 /**
- * Works like _strftime(3)_ but expects a `time_t` timestamp instead of a
- * `struct tm *` and accepts an additional parameter, the time zone in which
- * the conversion should take place.
+ * Values of the "status" attribute of a power supply that are recognized.
+ */
+typedef enum {
+    BATTERY_STATUS_UNKNOWN,
+    BATTERY_STATUS_CHARGING,
+    BATTERY_STATUS_DISCHARGING,
+    BATTERY_STATUS_NOT_CHARGING,
+    BATTERY_STATUS_FULL,
+} battery_status_et;
+
+/**
+ * Battery whose data files are kept open between reads. The "capacity" and
+ * "status" sysfs attributes are preferred, but when they are not available,
+ * the uevent file is parsed instead.
+ */
+typedef struct {
+    /**
+     * Path of the uevent file e.g. "/sys/class/power_supply/BAT0/uevent".
+     * The attributes are expected to be in the same directory.
+     */
+    const char *path;
+    /**
+     * File descriptor of the "capacity" attribute or -1 if it is not open.
+     */
+    int capacity_fd;
+    /**
+     * File descriptor of the "status" attribute or -1 if it is not open.
+     */
+    int status_fd;
+    /**
+     * File descriptor of the uevent file or -1 if it is not open. This is
+     * only used when the attributes could not be opened.
+     */
+    int uevent_fd;
+    /**
+     * File descriptors of the attributes in "battery_energy_attributes"
+     * indexed by "battery_energy_et". Each is -1 if it is not open. These are
+     * optional, so they are not reopened when they are missing.
+     */
+    int energy_fds[3];
+    /**
+     * Index of the row of "battery_energy_attributes" the energy attributes
+     * were opened from.
+     */
+    int energy_units;
+} battery_st;
+
+/**
+ * Indexes of the values describing the energy stored in a battery.
+ */
+typedef enum {
+    BATTERY_ENERGY_NOW,
+    BATTERY_ENERGY_FULL,
+    BATTERY_ENERGY_RATE,
+} battery_energy_et;
+
+/**
+ * Names of the attributes describing the energy stored in a battery. Most
+ * drivers report µWh and µW, but some only report µAh and µA, so the second
+ * row is used when "energy_now" does not exist.
+ */
+static const char *const battery_energy_attributes[][3] = {
+    {"energy_now", "energy_full", "power_now"},
+    {"charge_now", "charge_full", "current_now"},
+};
+
+/**
+ * State of a battery read by "read_battery".
+ */
+typedef struct {
+    /**
+     * Percentage of the battery that is charged or -1 if it is unknown.
+     */
+    int capacity;
+    battery_status_et status;
+    /**
+     * Values indexed by "battery_energy_et". Each is -1 if it is unknown.
+     */
+    long energy[3];
+    /**
+     * Row of "battery_energy_attributes" describing the units of "energy".
+     */
+    int energy_units;
+} battery_reading_st;
+
+/**
+ * Cached model of the power supplies of the system. The supplies are only
+ * enumerated when the model is created and when the kernel reports that a
+ * supply was added or removed, so refreshing the indicator only reads
+ * attributes from files that are already open.
+ */
+typedef struct {
+    /**
+     * Directory containing a subdirectory for every power supply or NULL if
+     * only the battery in "batteries[0]" is used.
+     */
+    const char *directory;
+    /**
+     * Batteries powering the system. When "directory" is set, the path of
+     * each battery is stored in the corresponding member of "paths".
+     */
+    battery_st batteries[POWER_SUPPLY_LIMIT];
+    char paths[POWER_SUPPLY_LIMIT][256];
+    size_t battery_count;
+    /**
+     * File descriptors of the "online" attributes of the external power
+     * supplies e.g. AC adapters and USB chargers.
+     */
+    int mains_fds[POWER_SUPPLY_LIMIT];
+    size_t mains_count;
+    /**
+     * Indicates whether the supplies must be enumerated before the next read.
+     */
+    int stale;
+    /**
+     * Exponential moving average of the rate at which the batteries are
+     * charging or discharging or 0 if it is unknown.
+     */
+    double rate;
+    /**
+     * Direction the batteries were going when "rate" was last updated: 1 for
+     * charging, -1 for discharging and 0 for neither.
+     */
+    int rate_trend;
+    /**
+     * Unix timestamp at which "rate" was last updated.
+     */
+    time_t rate_updated;
+} power_supplies_st;
+
+/**
+ * Identifiers for the indicators whose text is cached between refreshes. The
+ * indicators are displayed in this order.
+ */
+typedef enum {
+    INDICATOR_SUNRISE_SUNSET,
+    INDICATOR_MOON_PHASE,
+    INDICATOR_DATE,
+    INDICATOR_COUNT,
+} indicator_et;
+
+/**
+ * Cached text of an indicator along with the information needed to decide
+ * when it must be regenerated.
+ */
+typedef struct {
+    /**
+     * Unix timestamp at which the text expires or 0 if it does not expire.
+     * This is set after the indicator has been refreshed.
+     */
+    time_t expires;
+    /**
+     * Value the text was derived from.
+     */
+    long source;
+    /**
+     * Indicates whether the text is usable.
+     */
+    int valid;
+    /**
+     * Text of the indicator including its trailing separator or an empty
+     * string if the indicator is not displayed.
+     */
+    char text[128];
+} indicator_st;
+
+/**
+ * Text of the indicators loaded by the source worker. Once a snapshot has
+ * been published, it is never modified, so the main thread can display it
+ * without holding any locks.
+ */
+typedef struct {
+    /**
+     * Battery indicator followed by a separator or an empty string.
+     */
+    char battery[128];
+    /**
+     * Indicators loaded from the status file, each followed by a separator.
+     */
+    char status_file[1024];
+} source_snapshot_st;
+
+/**
+ * Sources whose data may be slow to load e.g. a status file on a stalled
+ * network filesystem. They are refreshed by a worker thread that publishes a
+ * new snapshot whenever their text changes, so the clock never waits on them.
+ * Apart from "lock" and "pending", every member is only used by the worker
+ * once it has been started.
+ */
+typedef struct {
+    /**
+     * Lock protecting "pending".
+     */
+    pthread_mutex_t lock;
+    /**
+     * Latest snapshot that has not been taken by the main thread or NULL.
+     */
+    source_snapshot_st *pending;
+    /**
+     * Write end of a pipe that a byte is written to whenever a snapshot is
+     * published or -1 if the main thread does not need to be woken.
+     */
+    int notify_fd;
+    /**
+     * Text of the indicators as of the last refresh.
+     */
+    source_snapshot_st current;
+    /**
+     * Indicates whether the sources have been refreshed at least once.
+     */
+    int loaded;
+    /**
+     * Power supplies shown in the battery indicator. The indicator is hidden
+     * when there is neither a directory nor a battery.
+     */
+    power_supplies_st power_supplies;
+    /**
+     * Seconds between refreshes of the battery indicator.
+     */
+    time_t battery_interval;
+    /**
+     * Unix timestamp at which the battery indicator must be refreshed. This
+     * is aligned to a multiple of "battery_interval".
+     */
+    time_t battery_expires;
+    /**
+     * Socket returned by "open_uevent_socket" or -1.
+     */
+    int uevent_socket;
+    /**
+     * Path of the status file or NULL.
+     */
+    const char *status_file;
+    /**
+     * Base name of the status file.
+     */
+    const char *status_name;
+    /**
+     * File descriptor returned by "open_status_file_watch" or -1 if the mtime
+     * of the status file is checked every second instead.
+     */
+    int status_watch;
+    /**
+     * Modification time of the status file when it was last loaded or -1.
+     */
+    double status_file_mt;
+} sources_st;
+
+/**
+ * Local time type i.e. an offset from UTC and the abbreviation used while it
+ * is in effect.
+ */
+typedef struct {
+    /**
+     * Offset from UTC in seconds. This is positive east of Greenwich.
+     */
+    long utoff;
+    /**
+     * Indicates whether this is daylight saving time.
+     */
+    int isdst;
+    /**
+     * Time zone abbreviation e.g. "PST".
+     */
+    char abbreviation[16];
+} zone_type_st;
+
+/**
+ * Rule from a POSIX TZ string describing when a daylight saving time
+ * transition happens.
+ */
+typedef struct {
+    /**
+     * "J" when "day" is a day of the year from 1 to 365 that never counts
+     * February 29th, "D" when "day" is a zero-based day of the year that does
+     * and "M" when the rule refers to a day of the week in a month.
+     */
+    char kind;
+    /**
+     * Day of the year or, for "M" rules, the day of the week where 0 is
+     * Sunday.
+     */
+    int day;
+    /**
+     * Week of the month from 1 to 5 where 5 is the last week.
+     */
+    int week;
+    /**
+     * Month from 1 to 12.
+     */
+    int month;
+    /**
+     * Local time of the transition in seconds after midnight. This may be
+     * negative or exceed one day.
+     */
+    long time;
+} zone_rule_st;
+
+/**
+ * Time zone described by a POSIX TZ string e.g. "PST8PDT,M3.2.0,M11.1.0".
+ */
+typedef struct {
+    /**
+     * Standard time.
+     */
+    zone_type_st std;
+    /**
+     * Daylight saving time.
+     */
+    zone_type_st dst;
+    /**
+     * Indicates whether the time zone observes daylight saving time.
+     */
+    int has_dst;
+    /**
+     * Start of daylight saving time.
+     */
+    zone_rule_st start;
+    /**
+     * End of daylight saving time.
+     */
+    zone_rule_st end;
+} posix_tz_st;
+
+/**
+ * Time zone loaded into memory so local times can be computed without the C
+ * library's global time zone state.
+ */
+typedef struct {
+    /**
+     * Name the time zone was loaded with or NULL for the system default.
+     */
+    const char *name;
+    /**
+     * Path of the TZif file or NULL if the time zone was described by a POSIX
+     * TZ string.
+     */
+    char *path;
+    /**
+     * Identity of the TZif file when it was last loaded.
+     */
+    dev_t device;
+    ino_t inode;
+    time_t mtime;
+    off_t size;
+    /**
+     * Sorted list of Unix timestamps at which the local time type changes.
+     */
+    int64_t *transitions;
+    /**
+     * Index into "types" of the local time type in effect from the
+     * corresponding transition onward.
+     */
+    unsigned char *transition_types;
+    /**
+     * Number of transitions.
+     */
+    size_t transition_count;
+    /**
+     * Local time types. The first one is used for times before the first
+     * transition.
+     */
+    zone_type_st *types;
+    /**
+     * Number of local time types.
+     */
+    size_t type_count;
+    /**
+     * Rules used for times after the last transition.
+     */
+    posix_tz_st footer;
+    /**
+     * Indicates whether "footer" is set.
+     */
+    int has_footer;
+    /**
+     * Indicates whether the time zone has been loaded successfully.
+     */
+    int loaded;
+} time_zone_st;
+
+/**
+ * Read an unsigned big-endian integer.
+ *
+ * Arguments:
+ * - src: Location of the integer.
+ * - width: Size of the integer in bytes.
+ *
+ * Return: The integer.
+ */
+static uint64_t load_be(const unsigned char *src, size_t width)
+{
+    uint64_t value = 0;
+
+    while (width--) {
+        value = value << 8 | *src++;
+    }
+
+    return value;
+}
+
+/**
+ * Read a two's complement, big-endian integer.
+ *
+ * Arguments:
+ * - src: Location of the integer.
+ * - width: Size of the integer in bytes; this must be 4 or 8.
+ *
+ * Return: The integer.
+ */
+static int64_t load_be_signed(const unsigned char *src, size_t width)
+{
+    uint64_t value = load_be(src, width);
+
+    if (width == 4) {
+        return (int32_t) (uint32_t) value;
+    }
+
+    return (int64_t) value;
+}
+
+/**
+ * Parse an unsigned decimal number in a POSIX TZ string.
+ *
+ * Arguments:
+ * - text: Start of the number.
+ * - value: Output pointer for the number.
+ * - max: Largest acceptable value.
+ *
+ * Return: A pointer to the byte following the number or NULL if the number is
+ * missing or out of range.
+ */
+static const char *parse_tz_number(const char *text, long *value, long max)
+{
+    long number = 0;
+
+    if (!isdigit((unsigned char) *text)) {
+        return NULL;
+    }
+
+    for (; isdigit((unsigned char) *text); text++) {
+        if ((number = number * 10 + (*text - '0')) > max) {
+            return NULL;
+        }
+    }
+
+    *value = number;
+    return text;
+}
+
+/**
+ * Parse a time zone abbreviation in a POSIX TZ string. The abbreviation must
+ * be at least three letters or, when quoted with angle brackets, consist of
+ * at least three letters, digits, "+" or "-" characters.
+ *
+ * Arguments:
+ * - text: Start of the abbreviation.
+ * - dest: Output buffer for the abbreviation.
+ * - sizeofdest: Size of "dest".
+ *
+ * Return: A pointer to the byte following the abbreviation or NULL if it is
+ * malformed or too long.
+ */
+static const char *parse_tz_abbreviation(const char *text, char *dest,
+  size_t sizeofdest)
+{
+    const char *end;
+    size_t length;
+
+    int quoted = *text == '<';
+
+    text += quoted;
+
+    for (end = text; isalpha((unsigned char) *end) || (quoted &&
+      (isdigit((unsigned char) *end) || *end == '+' || *end == '-')); end++);
+
+    length = (size_t) (end - text);
+
+    if (length < 3 || length >= sizeofdest || (quoted && *end++ != '>')) {
+        return NULL;
+    }
+
+    memcpy(dest, text, length);
+    dest[length] = '\0';
+    return end;
+}
+
+/**
+ * Parse a time of day or UTC offset in a POSIX TZ string i.e. an optional sign
+ * followed by "hh[:mm[:ss]]".
+ *
+ * Arguments:
+ * - text: Start of the time.
+ * - seconds: Output pointer for the time in seconds.
+ * - max_hours: Largest acceptable number of hours.
+ *
+ * Return: A pointer to the byte following the time or NULL if it is malformed.
+ */
+static const char *parse_tz_time(const char *text, long *seconds,
+  long max_hours)
+{
+    long hours;
+
+    long minutes = 0;
+    int negative = *text == '-';
+    long secs = 0;
+
+    if (*text == '+' || *text == '-') {
+        text++;
+    }
+
+    if (!(text = parse_tz_number(text, &hours, max_hours))) {
+        return NULL;
+    }
+
+    if (*text == ':') {
+        if (!(text = parse_tz_number(text + 1, &minutes, 59))) {
+            return NULL;
+        } else if (*text == ':' &&
+          !(text = parse_tz_number(text + 1, &secs, 59))) {
+            return NULL;
+        }
+    }
+
+    *seconds = (hours * 3600 + minutes * 60 + secs) * (negative ? -1 : 1);
+    return text;
+}
+
+/**
+ * Parse a daylight saving time transition rule in a POSIX TZ string i.e.
+ * "Jn", "n" or "Mm.w.d" optionally followed by "/time".
+ *
+ * Arguments:
+ * - text: Start of the rule.
+ * - rule: Output pointer for the rule.
+ *
+ * Return: A pointer to the byte following the rule or NULL if it is
+ * malformed.
+ */
+static const char *parse_tz_rule(const char *text, zone_rule_st *rule)
+{
+    long day;
+    long month;
+    long week;
+
+    if (*text == 'J') {
+        rule->kind = 'J';
+        text = parse_tz_number(text + 1, &day, 365);
+
+        if (text && day < 1) {
+            return NULL;
+        }
+    } else if (*text == 'M') {
+        rule->kind = 'M';
+
+        if (!(text = parse_tz_number(text + 1, &month, 12)) || month < 1 ||
+          *text != '.' || !(text = parse_tz_number(text + 1, &week, 5)) ||
+          week < 1 || *text != '.' ||
+          !(text = parse_tz_number(text + 1, &day, 6))) {
+            return NULL;
+        }
+
+        rule->month = (int) month;
+        rule->week = (int) week;
+    } else {
+        rule->kind = 'D';
+        text = parse_tz_number(text, &day, 365);
+    }
+
+    if (!text) {
+        return NULL;
+    }
+
+    rule->day = (int) day;
+    rule->time = 7200;
+
+    // Version 3 of the TZif format allows hours from -167 to 167.
+    return *text == '/' ? parse_tz_time(text + 1, &rule->time, 167) : text;
+}
+
+/**
+ * Parse a POSIX TZ string e.g. "PST8PDT,M3.2.0,M11.1.0".
+ *
+ * Arguments:
+ * - text: TZ string.
+ * - tz: Output pointer for the parsed time zone.
+ *
+ * Return: 0 if the string was valid and -1 otherwise.
+ */
+static int parse_posix_tz(const char *text, posix_tz_st *tz)
+{
+    long offset;
+
+    memset(tz, 0, sizeof(*tz));
+
+    if (!(text = parse_tz_abbreviation(text, tz->std.abbreviation,
+      sizeof(tz->std.abbreviation))) ||
+      !(text = parse_tz_time(text, &offset, 24))) {
+        return -1;
+    }
+
+    // POSIX offsets are positive west of Greenwich.
+    tz->std.utoff = -offset;
+
+    if (!*text) {
+        return 0;
+    } else if (!(text = parse_tz_abbreviation(text, tz->dst.abbreviation,
+      sizeof(tz->dst.abbreviation)))) {
+        return -1;
+    }
+
+    tz->has_dst = 1;
+    tz->dst.isdst = 1;
+    tz->dst.utoff = tz->std.utoff + 3600;
+
+    if (*text && *text != ',') {
+        if (!(text = parse_tz_time(text, &offset, 24))) {
+            return -1;
+        }
+
+        tz->dst.utoff = -offset;
+    }
+
+    // Without explicit rules, the current rules for the United States are
+    // used like most other implementations do.
+    if (!*text) {
+        tz->start = (zone_rule_st) {.kind = 'M', .month = 3, .week = 2,
+                                    .time = 7200};
+        tz->end = (zone_rule_st) {.kind = 'M', .month = 11, .week = 1,
+                                  .time = 7200};
+        return 0;
+    }
+
+    if (*text != ',' || !(text = parse_tz_rule(text + 1, &tz->start)) ||
+      *text != ',' || !(text = parse_tz_rule(text + 1, &tz->end)) || *text) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Compute the number of days between the Unix epoch and a date in the
+ * proleptic Gregorian calendar.
+ *
+ * Arguments:
+ * - year
+ * - month: Month from 1 to 12.
+ * - day: Day of the month from 1 to 31.
+ *
+ * Return: Number of days since 1970-01-01.
+ */
+static int64_t days_since_epoch(int64_t year, int month, int day)
+{
+    int64_t day_of_era;
+    int64_t day_of_year;
+    int64_t era;
+    int64_t year_of_era;
+
+    // Years are shifted to start in March so leap days fall at the end.
+    year -= month <= 2;
+    era = (year >= 0 ? year : year - 399) / 400;
+    year_of_era = year - era * 400;
+    day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day -
+        1;
+    day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+        day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+/**
+ * Determine the day on which a daylight saving time rule takes effect.
+ *
+ * Arguments:
+ * - rule
+ * - year
+ *
+ * Return: Number of days between the Unix epoch and the day of the
+ * transition.
+ */
+static int64_t rule_day(const zone_rule_st *rule, int64_t year)
+{
+    int days_in_month;
+    int64_t first;
+    int weekday;
+
+    int leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+
+    switch (rule->kind) {
+      case 'J':
+        // February 29th is never counted.
+        return days_since_epoch(year, 1, 1) + rule->day - 1 +
+          (leap && rule->day >= 60);
+
+      case 'D':
+        return days_since_epoch(year, 1, 1) + rule->day;
+    }
+
+    first = days_since_epoch(year, rule->month, 1);
+    days_in_month = (int) (days_since_epoch(year + rule->month / 12,
+      rule->month % 12 + 1, 1) - first);
+
+    // The Unix epoch was a Thursday.
+    weekday = (int) (((first + 4) % 7 + 7) % 7);
+    first += (rule->day - weekday + 7) % 7 + (rule->week - 1) * 7;
+
+    // Week 5 means the last week, which may be the fourth one.
+    return first - (first >= days_since_epoch(year, rule->month, 1) +
+      days_in_month ? 7 : 0);
+}
+
+/**
+ * Determine the local time type in effect at a given time for a time zone
+ * described by a POSIX TZ string.
+ *
+ * Arguments:
+ * - tz: Time zone.
+ * - when: Unix timestamp.
+ *
+ * Return: The local time type.
+ */
+static const zone_type_st *posix_tz_type(const posix_tz_st *tz, time_t when)
+{
+    int64_t end;
+    int64_t start;
+    struct tm tm;
+
+    time_t local = when + tz->std.utoff;
+
+    if (!tz->has_dst || !gmtime_r(&local, &tm)) {
+        return &tz->std;
+    }
+
+    // The start of daylight saving time is expressed in standard time and the
+    // end in daylight saving time.
+    start = rule_day(&tz->start, tm.tm_year + 1900LL) * 86400 +
+        tz->start.time - tz->std.utoff;
+    end = rule_day(&tz->end, tm.tm_year + 1900LL) * 86400 + tz->end.time -
+        tz->dst.utoff;
+
+    // In the southern hemisphere, daylight saving time spans the new year.
+    if (start < end) {
+        return when >= start && when < end ? &tz->dst : &tz->std;
+    }
+
+    return when >= end && when < start ? &tz->std : &tz->dst;
+}
+
+/**
+ * Parse the contents of a TZif file as described in RFC 8536. Leap second
+ * records are ignored.
+ *
+ * Arguments:
+ * - data: Contents of the file.
+ * - size: Size of the file.
+ * - zone: The transitions, local time types and footer are stored in this
+ *   structure. The arrays are allocated with malloc(3).
+ *
+ * Return: 0 on success and -1 if the file is malformed or memory could not be
+ * allocated.
+ */
+static int parse_tzif(const unsigned char *data, size_t size,
+  time_zone_st *zone)
+{
+    const unsigned char *abbreviations;
+    const unsigned char *block;
+    size_t block_size;
+    uint64_t charcnt;
+    const unsigned char *footer;
+    const unsigned char *footer_end;
+    uint64_t isstdcnt;
+    uint64_t isutcnt;
+    uint64_t leapcnt;
+    const unsigned char *record;
+    uint64_t timecnt;
+    uint64_t typecnt;
+
+    const unsigned char *header = data;
+    size_t time_size = 4;
+
+    while (1) {
+        if (size < 44 || (size_t) (header - data) > size - 44 ||
+          memcmp(header, "TZif", 4)) {
+            return -1;
+        }
+
+        isutcnt = load_be(header + 20, 4);
+        isstdcnt = load_be(header + 24, 4);
+        leapcnt = load_be(header + 28, 4);
+        timecnt = load_be(header + 32, 4);
+        typecnt = load_be(header + 36, 4);
+        charcnt = load_be(header + 40, 4);
+
+        // The counts are 32-bit values, so this cannot overflow.
+        block_size = (size_t) (timecnt * (time_size + 1) + typecnt * 6 +
+            charcnt + leapcnt * (time_size + 4) + isstdcnt + isutcnt);
+        block = header + 44;
+
+        if (block_size > size - (size_t) (block - data) || !typecnt ||
+          !charcnt) {
+            return -1;
+        }
+
+        // Version 1 data only has 32-bit timestamps, so the second header
+        // and data block with 64-bit timestamps are used when present.
+        if (time_size == 8 || header[4] < '2') {
+            break;
+        }
+
+        header = block + block_size;
+        time_size = 8;
+    }
+
+    zone->transitions = malloc(timecnt * sizeof(*zone->transitions) + 1);
+    zone->transition_types = malloc(timecnt + 1);
+    zone->types = malloc(typecnt * sizeof(*zone->types));
+
+    if (!zone->transitions || !zone->transition_types || !zone->types) {
+        return -1;
+    }
+
+    zone->transition_count = (size_t) timecnt;
+    zone->type_count = (size_t) typecnt;
+    record = block;
+
+    for (size_t n = 0; n < timecnt; n++, record += time_size) {
+        zone->transitions[n] = load_be_signed(record, time_size);
+    }
+
+    for (size_t n = 0; n < timecnt; n++, record++) {
+        if ((zone->transition_types[n] = *record) >= typecnt) {
+            return -1;
+        }
+    }
+
+    abbreviations = record + typecnt * 6;
+
+    for (size_t n = 0; n < typecnt; n++, record += 6) {
+        zone->types[n].utoff = (long) load_be_signed(record, 4);
+        zone->types[n].isdst = record[4];
+
+        if (record[5] >= charcnt || !memchr(abbreviations + record[5], '\0',
+          (size_t) charcnt - record[5])) {
+            return -1;
+        }
+
+        strncpy(zone->types[n].abbreviation,
+                (const char *) abbreviations + record[5],
+                sizeof(zone->types[n].abbreviation) - 1);
+        zone->types[n].abbreviation[
+            sizeof(zone->types[n].abbreviation) - 1] = '\0';
+    }
+
+    // The footer is a POSIX TZ string surrounded by newlines that describes
+    // the times after the last transition. An empty or unsupported footer is
+    // ignored.
+    footer = block + block_size;
+    zone->has_footer = 0;
+
+    if (time_size == 8 && footer < data + size && *footer++ == '\n' &&
+      (footer_end = memchr(footer, '\n', (size_t) (data + size - footer))) &&
+      footer_end != footer && footer_end - footer < 256) {
+        char text[256];
+
+        memcpy(text, footer, (size_t) (footer_end - footer));
+        text[footer_end - footer] = '\0';
+        zone->has_footer = !parse_posix_tz(text, &zone->footer);
+    }
+
+    return 0;
+}
+
+/**
+ * Release the memory used by a time zone's transition tables.
+ *
+ * Arguments:
+ * - zone
+ */
+static void free_time_zone_tables(time_zone_st *zone)
+{
+    free(zone->transitions);
+    free(zone->transition_types);
+    free(zone->types);
+    zone->transitions = NULL;
+    zone->transition_types = NULL;
+    zone->types = NULL;
+    zone->transition_count = 0;
+    zone->type_count = 0;
+}
+
+/**
+ * Load the TZif file of a time zone into memory. If the file cannot be
+ * loaded, the time zone is left unchanged.
+ *
+ * Arguments:
+ * - zone: Time zone with a "path".
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int load_time_zone_file(time_zone_st *zone)
+{
+    unsigned char *data;
+    int fd;
+    time_zone_st loaded;
+    ssize_t result;
+    struct stat status;
+
+    size_t size = 0;
+
+    while ((fd = open(zone->path, O_RDONLY)) == -1) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+
+    if (fstat(fd, &status) || status.st_size > TZIF_SIZE_LIMIT ||
+      !(data = malloc((size_t) status.st_size + 1))) {
+        close(fd);
+        return -1;
+    }
+
+    // One extra byte is requested so files that grew can be detected.
+    while (size <= (size_t) status.st_size) {
+        if ((result = read(fd, data + size, (size_t) status.st_size + 1 -
+          size)) == -1 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            break;
+        }
+
+        size += (size_t) result;
+    }
+
+    close(fd);
+    loaded = *zone;
+    loaded.transitions = NULL;
+    loaded.transition_types = NULL;
+    loaded.types = NULL;
+
+    if (result == -1 || size != (size_t) status.st_size ||
+      parse_tzif(data, size, &loaded)) {
+        free(data);
+        free_time_zone_tables(&loaded);
+        return -1;
+    }
+
+    free(data);
+    free_time_zone_tables(zone);
+    *zone = loaded;
+    zone->device = status.st_dev;
+    zone->inode = status.st_ino;
+    zone->mtime = status.st_mtime;
+    zone->size = status.st_size;
+    zone->loaded = 1;
+    return 0;
+}
+
+/**
+ * Load a time zone. Like most C libraries, the name is first treated as the
+ * path of a TZif file, relative to the zoneinfo directory unless it is
+ * absolute, and then as a POSIX TZ string if no such file exists.
+ *
+ * Arguments:
+ * - zone: Output pointer for the time zone.
+ * - name: Name of the time zone e.g. "America/Los_Angeles". When this is
+ *   NULL, the system's default time zone is loaded.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int load_time_zone(time_zone_st *zone, const char *name)
+{
+    const char *directory;
+
+    memset(zone, 0, sizeof(*zone));
+    zone->name = name;
+
+    if (name && *name == ':') {
+        name++;
+    }
+
+    if (name && !*name) {
+        name = "UTC0";
+    } else if (!name) {
+        zone->path = strdup(LOCAL_TIME_ZONE_PATH);
+    } else if (*name == '/') {
+        zone->path = strdup(name);
+    } else {
+        if (!(directory = getenv("TZDIR")) || !*directory) {
+            directory = ZONEINFO_DIRECTORY;
+        }
+
+        if ((zone->path = malloc(strlen(directory) + strlen(name) + 2))) {
+            sprintf(zone->path, "%s/%s", directory, name);
+        }
+    }
+
+    if (zone->path && !load_time_zone_file(zone)) {
+        return 0;
+    }
+
+    free(zone->path);
+    zone->path = NULL;
+
+    if (name && !parse_posix_tz(name, &zone->footer)) {
+        zone->has_footer = 1;
+        zone->loaded = 1;
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Reload a time zone if its TZif file has been replaced or modified since it
+ * was last loaded. Only the file's metadata is examined otherwise.
+ *
+ * Arguments:
+ * - zone
+ *
+ * Return: 1 if the time zone was reloaded and 0 otherwise.
+ */
+static int refresh_time_zone(time_zone_st *zone)
+{
+    struct stat status;
+
+    if (!zone->path || stat(zone->path, &status) ||
+      (status.st_dev == zone->device && status.st_ino == zone->inode &&
+      status.st_mtime == zone->mtime && status.st_size == zone->size)) {
+        return 0;
+    }
+
+    if (!load_time_zone_file(zone)) {
+        return 1;
+    }
+
+    // If the new file cannot be loaded, the old tables are kept, and loading
+    // is not attempted again until the file changes.
+    zone->device = status.st_dev;
+    zone->inode = status.st_ino;
+    zone->mtime = status.st_mtime;
+    zone->size = status.st_size;
+    return 0;
+}
+
+/**
+ * Determine the local time type in effect at a given time.
+ *
+ * Arguments:
+ * - zone: Time zone.
+ * - when: Unix timestamp.
+ *
+ * Return: The local time type.
+ */
+static const zone_type_st *time_zone_type(const time_zone_st *zone,
+  time_t when)
+{
+    size_t middle;
+
+    size_t count = zone->transition_count;
+    size_t high = count;
+    size_t low = 0;
+
+    if (!count || when >= zone->transitions[count - 1]) {
+        if (zone->has_footer) {
+            return posix_tz_type(&zone->footer, when);
+        }
+
+        return &zone->types[count ? zone->transition_types[count - 1] : 0];
+    } else if (when < zone->transitions[0]) {
+        return &zone->types[0];
+    }
+
+    // Find the last transition that is not after "when".
+    while (high - low > 1) {
+        middle = low + (high - low) / 2;
+
+        if (zone->transitions[middle] <= when) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return &zone->types[zone->transition_types[low]];
+}
+
+/**
+ * Convert a timestamp into the broken-down local time of a time zone.
+ *
+ * Arguments:
+ * - zone: Time zone.
+ * - when: Unix timestamp.
+ * - tm: Output pointer for the local time.
+ *
+ * Return: The local time type in effect or NULL if the time could not be
+ * converted.
+ */
+static const zone_type_st *time_zone_localtime(const time_zone_st *zone,
+  time_t when, struct tm *tm)
+{
+    const zone_type_st *type = time_zone_type(zone, when);
+    time_t local = when + type->utoff;
+
+    if (!gmtime_r(&local, tm)) {
+        return NULL;
+    }
+
+    tm->tm_isdst = type->isdst;
+    return type;
+}
+
+/**
+ * Works like _strftime(3)_ but expects a `time_t` timestamp instead of a
+ * `struct tm *` and accepts an additional parameter, the time zone in which
+ * the conversion should take place.
+ *
+ * Arguments:
+ * - dest: The result will written to this character array.
+ * - sizeofdest: Size of the result buffer.
+ * - format: Format string as defined for _strftime(3)_.
+ * - when: Unix timestamp representing the time to be formatted.
+ * - zone: Time zone in which the conversion takes place.
+ *
+ * Return: Number of bytes written to "dest" excluding the null byte.
+ */
+static size_t tzstrftime(char *dest, size_t sizeofdest, const char *format,
+  time_t when, const time_zone_st *zone)
+{
+    char expanded[256];
+    size_t length;
+    struct tm tm;
+    const zone_type_st *type;
+
+    char *cursor = expanded;
+    size_t rval = 0;
+
+    if (!(type = time_zone_localtime(zone, when, &tm))) {
+        return 0;
+    }
+
+    // Since the broken-down time is not associated with the C library's
+    // notion of the time zone, "%Z" is expanded here.
+    for (; *format; format++) {
+        length = format[0] == '%' && format[1] == 'Z' ?
+            strlen(type->abbreviation) : 1 + (size_t) (format[0] == '%' &&
+            format[1]);
+
+        if (length >= sizeof(expanded) - (size_t) (cursor - expanded)) {
+            errno = EOVERFLOW;
+            return 0;
+        } else if (format[0] == '%' && format[1] == 'Z') {
+            cursor = stpcpy(cursor, type->abbreviation);
+            format++;
+        } else {
+            memcpy(cursor, format, length);
+            cursor += length;
+            format += length - 1;
+        }
+    }
+
+    *cursor = '\0';
+
+    if ((rval = strftime(dest, sizeofdest, expanded, &tm))) {
+        gmt_to_utc(dest);
+    }
+
+    return rval;
+}
+
+/**
+ * Determine whether an indicator must be refreshed and, if so, mark it as
+ * refreshed. The caller may then set the time at which the new text expires.
+ *
+ * Arguments:
+ * - indicator
+ * - now: Current Unix timestamp.
+ * - source: Value the text of the indicator is derived from. The indicator is
+ *   always refreshed when this changes.
+ *
+ * Return: Non-zero if the indicator must be refreshed.
+ */
+static int indicator_due(indicator_st *indicator, time_t now, long source)
+{
+    if (indicator->valid && indicator->source == source &&
+      (!indicator->expires || now < indicator->expires)) {
+        return 0;
+    }
+
+    indicator->valid = 1;
+    indicator->source = source;
+    indicator->expires = 0;
+    return 1;
+}
+
+/**
+ * Write the day of the week and an ordinal day of the month to "dest" e.g.
+ * "Wed. the 21st."
+ *
+ * Arguments:
+ * - dest: The string will be written to this character array.
+ * - sizeofdest: Size of "dest".
+ * - tm: Time structure representing the date to be displayed.
+ *
+ * Return: Number of bytes written to "dest" not including the null byte.
+ */
+static size_t dow_with_ordinal_dom(char *dest, size_t sizeofdest,
+  struct tm *tm)
+{
+    size_t k;
+    char *cursor = dest;
+
+    // The "xx" reserve spaces for the ordinal indicator so strftime will fail
+    // if the destination array is too small.
+    if (!(k = strftime(dest, sizeofdest, "%a. the %dxx", tm))) {
+        return 0;
+    }
+
+    cursor += k - 2;
+
+    // Remove leading 0 from day of month. Some strftime implementations
+    // support "%-d" to achieve this, but it is not part of the ISO C99
+    // standard.
+    if (tm->tm_mday < 10) {
+        *(cursor - 2) = *(cursor - 1);
+        cursor--;
+    }
+
+    if (tm->tm_mday == 11 || tm->tm_mday == 12 || tm->tm_mday == 13) {
+        cursor = stpcpy(cursor, "th");
+    } else {
+        switch (tm->tm_mday % 10) {
+          case 1:
+            cursor = stpcpy(cursor, "st");
+            break;
+          case 2:
+            cursor = stpcpy(cursor, "nd");
+            break;
+          case 3:
+            cursor = stpcpy(cursor, "rd");
+            break;
+          default:
+            cursor = stpcpy(cursor, "th");
+            break;
+        }
+    }
+
+    return (size_t) (cursor - dest);
+}
+
+/**
+ * Close the energy attributes of a battery.
+ *
+ * Arguments:
+ * - battery
+ */
+static void close_battery_energy(battery_st *battery)
+{
+    for (size_t k = 0; k < ARRAY_LENGTH(battery->energy_fds); k++) {
+        if (battery->energy_fds[k] != -1) {
+            close(battery->energy_fds[k]);
+            battery->energy_fds[k] = -1;
+        }
+    }
+}
+
+/**
+ * Close the data files of a battery so they are reopened by the next read.
+ *
+ * Arguments:
+ * - battery
+ */
+static void close_battery(battery_st *battery)
+{
+    int *fds[] = {
+        &battery->capacity_fd,
+        &battery->status_fd,
+        &battery->uevent_fd,
+    };
+
+    for (size_t k = 0; k < ARRAY_LENGTH(fds); k++) {
+        if (*fds[k] != -1) {
+            close(*fds[k]);
+            *fds[k] = -1;
+        }
+    }
+
+    close_battery_energy(battery);
+}
+
+/**
+ * Initialize a battery whose data files have not been opened.
+ *
+ * Arguments:
+ * - battery
+ * - path: Path of the uevent file of the battery.
+ */
+static void init_battery(battery_st *battery, const char *path)
+{
+    battery->path = path;
+    battery->capacity_fd = -1;
+    battery->status_fd = -1;
+    battery->uevent_fd = -1;
+    battery->energy_units = 0;
+
+    for (size_t k = 0; k < ARRAY_LENGTH(battery->energy_fds); k++) {
+        battery->energy_fds[k] = -1;
+    }
+}
+
+/**
+ * Open a file for reading, retrying when interrupted by a signal.
+ *
+ * Arguments:
+ * - path: Path of the file.
+ *
+ * Return: A file descriptor or -1 if the file could not be opened.
+ */
+static int open_readonly(const char *path)
+{
+    int fd;
+
+    while ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 && errno == EINTR);
+
+    return fd;
+}
+
+/**
+ * Open the data files of a battery unless they are already open.
+ *
+ * Arguments:
+ * - battery
+ *
+ * Return: 0 if the attributes or the uevent file are open and -1 otherwise.
+ */
+static int open_battery(battery_st *battery)
+{
+    size_t k;
+    char path[4096];
+    const char *slash;
+    int directory_length;
+    int units;
+
+    if (battery->capacity_fd != -1 || battery->uevent_fd != -1) {
+        return 0;
+    }
+
+    slash = strrchr(battery->path, '/');
+    directory_length = slash ? (int) (slash - battery->path) : 0;
+
+    if (slash && !strcmp(slash, "/uevent") &&
+      (size_t) directory_length + sizeof("/current_now") <= sizeof(path)) {
+        sprintf(path, "%.*s/capacity", directory_length, battery->path);
+
+        if ((battery->capacity_fd = open_readonly(path)) != -1) {
+            sprintf(path, "%.*s/status", directory_length, battery->path);
+            battery->status_fd = open_readonly(path);
+
+            for (units = 0; units < 2; units++) {
+                for (k = 0; k < 3; k++) {
+                    sprintf(path, "%.*s/%s", directory_length, battery->path,
+                      battery_energy_attributes[units][k]);
+                    battery->energy_fds[k] = open_readonly(path);
+                }
+
+                battery->energy_units = units;
+
+                if (battery->energy_fds[BATTERY_ENERGY_NOW] != -1) {
+                    break;
+                }
+
+                close_battery_energy(battery);
+            }
+
+            return 0;
+        }
+    }
+
+    battery->uevent_fd = open_readonly(battery->path);
+    return battery->uevent_fd == -1 ? -1 : 0;
+}
+
+/**
+ * Read a file from the beginning into a buffer. Since sysfs regenerates the
+ * contents of an attribute whenever it is read at offset 0, the same file
+ * descriptor can be reused for every read.
+ *
+ * Arguments:
+ * - fd: File descriptor.
+ * - dest: Output buffer. The data will be null-terminated.
+ * - sizeofdest: Size of "dest".
+ *
+ * Return: Number of bytes read or -1 if there was an error.
+ */
+static ssize_t pread_all(int fd, char *dest, size_t sizeofdest)
+{
+    ssize_t result;
+
+    while ((result = pread(fd, dest, sizeofdest - 1, 0)) == -1 &&
+      errno == EINTR);
+
+    if (result != -1) {
+        dest[result] = '\0';
+    }
+
+    return result;
+}
+
+/**
+ * Parse the capacity of a battery.
+ *
+ * Arguments:
+ * - text: Decimal percentage optionally followed by a newline.
+ *
+ * Return: The percentage or -1 if it is malformed or out of range.
+ */
+static int parse_battery_capacity(const char *text)
+{
+    int percent = 0;
+
+    if (*text < '0' || *text > '9') {
+        return -1;
+    }
+
+    for (; *text >= '0' && *text <= '9'; text++) {
+        if ((percent = percent * 10 + (*text - '0')) > 100) {
+            return -1;
+        }
+    }
+
+    return *text == '\0' || *text == '\n' ? percent : -1;
+}
+
+/**
+ * Parse the status of a battery.
+ *
+ * Arguments:
+ * - text: Status optionally followed by a newline.
+ *
+ * Return: The status or BATTERY_STATUS_UNKNOWN if it is not recognized.
+ */
+static battery_status_et parse_battery_status(const char *text)
+{
+    static const struct {
+        const char *name;
+        battery_status_et status;
+    } statuses[] = {
+        {"Charging", BATTERY_STATUS_CHARGING},
+        {"Discharging", BATTERY_STATUS_DISCHARGING},
+        {"Not charging", BATTERY_STATUS_NOT_CHARGING},
+        {"Full", BATTERY_STATUS_FULL},
+    };
+
+    size_t length = strcspn(text, "\n");
+
+    for (size_t k = 0; k < ARRAY_LENGTH(statuses); k++) {
+        if (length == strlen(statuses[k].name) &&
+          !memcmp(text, statuses[k].name, length)) {
+            return statuses[k].status;
+        }
+    }
+
+    return BATTERY_STATUS_UNKNOWN;
+}
+
+/**
+ * Parse an energy, charge or rate attribute of a battery.
+ *
+ * Arguments:
+ * - text: Decimal integer optionally followed by a newline.
+ *
+ * Return: The absolute value of the number or -1 if it is malformed. Some
+ * drivers report negative rates while discharging, so the sign is dropped.
+ */
+static long parse_battery_energy(const char *text)
+{
+    char *end;
+    long value;
+
+    errno = 0;
+    value = strtol(text, &end, 10);
+
+    if (errno || end == text || (*end != '\0' && *end != '\n')) {
+        return -1;
+    }
+
+    return value < 0 ? -value : value;
+}
+
+/**
+ * Read the state of a battery. The data files stay open between calls, and
+ * they are only reopened after an error.
+ *
+ * Arguments:
+ * - battery
+ * - reading: Output. Values that are unknown are set to -1 or
+ *   BATTERY_STATUS_UNKNOWN.
+ *
+ * Return: NULL if the battery data was read or, when it could not be opened
+ * or read, the text of the indicator describing the failure.
+ */
+static const char *read_battery(battery_st *battery,
+  battery_reading_st *reading)
+{
+    char buffer[4096];
+    size_t k;
+    size_t length;
+    const char *line;
+    const char *name;
+    int units;
+    long values[2][3];
+
+    reading->capacity = -1;
+    reading->status = BATTERY_STATUS_UNKNOWN;
+
+    for (k = 0; k < 3; k++) {
+        reading->energy[k] = values[0][k] = values[1][k] = -1;
+    }
+
+    if (open_battery(battery)) {
+        return "⚡-";
+    }
+
+    reading->energy_units = battery->energy_units;
+
+    if (battery->capacity_fd != -1) {
+        if (pread_all(battery->capacity_fd, buffer, sizeof(buffer)) == -1) {
+            close_battery(battery);
+            return "⚡!";
+        }
+
+        reading->capacity = parse_battery_capacity(buffer);
+
+        if (battery->status_fd != -1) {
+            if (pread_all(battery->status_fd, buffer, sizeof(buffer)) == -1) {
+                close_battery(battery);
+                return "⚡!";
+            }
+
+            reading->status = parse_battery_status(buffer);
+        }
+
+        for (k = 0; k < 3; k++) {
+            if (battery->energy_fds[k] != -1 && pread_all(
+              battery->energy_fds[k], buffer, sizeof(buffer)) != -1) {
+                reading->energy[k] = parse_battery_energy(buffer);
+            }
+        }
+
+        return NULL;
+    }
+
+    if (pread_all(battery->uevent_fd, buffer, sizeof(buffer)) == -1) {
+        close_battery(battery);
+        return "⚡!";
+    }
+
+    for (line = buffer; *line; line += strcspn(line, "\n"),
+      line += *line == '\n') {
+        if (!strncmp(line, "POWER_SUPPLY_CAPACITY=", 22)) {
+            reading->capacity = parse_battery_capacity(line + 22);
+        } else if (!strncmp(line, "POWER_SUPPLY_STATUS=", 20)) {
+            reading->status = parse_battery_status(line + 20);
+        } else if (!strncmp(line, "POWER_SUPPLY_", 13)) {
+            name = line + 13;
+            length = strcspn(name, "=\n");
+
+            for (units = 0; units < 2 && name[length] == '='; units++) {
+                for (k = 0; k < 3; k++) {
+                    if (!strncasecmp(name, battery_energy_attributes[units][k],
+                      length) &&
+                      !battery_energy_attributes[units][k][length]) {
+                        values[units][k] = parse_battery_energy(
+                            name + length + 1);
+                    }
+                }
+            }
+        }
+    }
+
+    units = values[0][BATTERY_ENERGY_NOW] == -1 &&
+        values[1][BATTERY_ENERGY_NOW] != -1;
+    reading->energy_units = units;
+    memcpy(reading->energy, values[units], sizeof(reading->energy));
+
+    return NULL;
+}
+
+/**
+ * Read a sysfs attribute of a power supply that is not kept open.
+ *
+ * Arguments:
+ * - directory: Directory of the power supply.
+ * - name: Name of the attribute.
+ * - dest: Output buffer. The trailing newline is removed.
+ * - sizeofdest: Size of "dest".
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int read_power_supply_attribute(const char *directory,
+  const char *name, char *dest, size_t sizeofdest)
+{
+    int fd;
+    char path[4096];
+    ssize_t size;
+
+    if ((size_t) snprintf(path, sizeof(path), "%s/%s", directory, name) >=
+      sizeof(path) || (fd = open_readonly(path)) == -1) {
+        return -1;
+    }
+
+    size = pread_all(fd, dest, sizeofdest);
+    close(fd);
+
+    if (size == -1) {
+        return -1;
+    }
+
+    dest[strcspn(dest, "\n")] = '\0';
+    return 0;
+}
+
+/**
+ * Enumerate the batteries and external power supplies in the power supply
+ * directory. Batteries that were already known keep their open files. The
+ * batteries of peripherals like wireless mice, whose "scope" is "Device", do
+ * not power the system, so they are ignored.
+ *
+ * Arguments:
+ * - supplies
+ */
+static void enumerate_power_supplies(power_supplies_st *supplies)
+{
+    battery_st *battery;
+    char buffer[64];
+    DIR *dir;
+    struct dirent *entry;
+    int fd;
+    size_t k;
+    battery_st old_batteries[POWER_SUPPLY_LIMIT];
+    size_t old_count;
+    char old_paths[POWER_SUPPLY_LIMIT][256];
+    char path[4096];
+    const char *uevent_path;
+
+    supplies->stale = 0;
+    old_count = supplies->battery_count;
+    memcpy(old_batteries, supplies->batteries, sizeof(old_batteries));
+    memcpy(old_paths, supplies->paths, sizeof(old_paths));
+    supplies->battery_count = 0;
+
+    for (k = 0; k < supplies->mains_count; k++) {
+        close(supplies->mains_fds[k]);
+    }
+
+    supplies->mains_count = 0;
+
+    if ((dir = opendir(supplies->directory))) {
+        while ((entry = readdir(dir))) {
+            if (entry->d_name[0] == '.' || (size_t) snprintf(path,
+              sizeof(path), "%s/%s", supplies->directory, entry->d_name) >=
+              sizeof(path) || read_power_supply_attribute(path, "type",
+              buffer, sizeof(buffer))) {
+                continue;
+            }
+
+            if (!strcmp(buffer, "Battery")) {
+                if (supplies->battery_count == POWER_SUPPLY_LIMIT ||
+                  (!read_power_supply_attribute(path, "scope", buffer,
+                  sizeof(buffer)) && !strcmp(buffer, "Device")) ||
+                  (size_t) snprintf(supplies->paths[supplies->battery_count],
+                  sizeof(supplies->paths[0]), "%s/uevent", path) >=
+                  sizeof(supplies->paths[0])) {
+                    continue;
+                }
+
+                battery = &supplies->batteries[supplies->battery_count];
+                uevent_path = supplies->paths[supplies->battery_count++];
+
+                for (k = 0; k < old_count; k++) {
+                    if (!strcmp(old_paths[k], uevent_path)) {
+                        break;
+                    }
+                }
+
+                if (k < old_count) {
+                    *battery = old_batteries[k];
+                    battery->path = uevent_path;
+                    old_paths[k][0] = '\0';
+                } else {
+                    init_battery(battery, uevent_path);
+                }
+            } else if ((!strcmp(buffer, "Mains") || !strcmp(buffer, "USB")) &&
+              supplies->mains_count < POWER_SUPPLY_LIMIT &&
+              (size_t) snprintf(path + strlen(path), sizeof(path) -
+              strlen(path), "/online") < sizeof(path) - strlen(path) &&
+              (fd = open_readonly(path)) != -1) {
+                supplies->mains_fds[supplies->mains_count++] = fd;
+            }
+        }
+
+        closedir(dir);
+    }
+
+    for (k = 0; k < old_count; k++) {
+        if (old_paths[k][0]) {
+            close_battery(&old_batteries[k]);
+        }
+    }
+}
+
+/**
+ * Return a string representing the combined state of the batteries. There
+ * are several different states (the XX below represents the charge
+ * percentage and H:MM the estimated time until the batteries are full or
+ * empty):
+ *
+ * - `⚡-`: Shown when the battery data could not be opened.
+ * - `⚡↑XX H:MM`: Shown when the batteries are charging.
+ * - `⚡↓XX H:MM`: Shown when the batteries are draining.
+ * - `⚡XX`: Shown when the batteries are not draining or charging.
+ * - `⚡?`: Shown when the battery data could not be parsed because the format
+ *   was not recognized.
+ * - `⚡!`: Shown when there was an error reading the battery data.
+ *
+ * The failure states are only shown when none of the batteries could be
+ * read. The percentage is the combined charge of the batteries weighted by
+ * their capacity, and the estimate is derived from a moving average of the
+ * rate reported by the batteries, so it is omitted when the batteries do not
+ * report their energy and rate in the same units. When the status of the
+ * batteries is unknown, an offline external power supply means they are
+ * draining.
+ *
+ * Arguments:
+ * - supplies: Power supplies whose state is displayed. They are enumerated
+ *   first when the model is stale.
+ * - now: Current Unix timestamp which is used to smooth the rate.
+ *
+ * Return: A pointer to a statically allocated array containing the indicator
+ * text. The text is empty when there are no batteries.
+ */
+static char *power_supply_indicator(power_supplies_st *supplies, time_t now)
+{
+    char buffer[48];
+    double elapsed;
+    const char *error;
+    size_t k;
+    long minutes;
+    battery_reading_st readings[POWER_SUPPLY_LIMIT];
+
+    double capacity = 0;
+    int charging = 0;
+    size_t count = 0;
+    int discharging = 0;
+    double energy = 0;
+    const char *failure = NULL;
+    double full = 0;
+    static char icon[32] = "";
+    int known_status = 0;
+    int mains_online = 0;
+    double rate = 0;
+    int trend = 0;
+    int units = -1;
+
+    if (supplies->directory && supplies->stale) {
+        enumerate_power_supplies(supplies);
+    }
+
+    if (!supplies->battery_count) {
+        return strcpy(icon, "");
+    }
+
+    for (k = 0; k < supplies->battery_count; k++) {
+        if ((error = read_battery(&supplies->batteries[k], &readings[k]))) {
+            // Batteries that cannot be read may have been removed.
+            supplies->stale = supplies->directory != NULL;
+            failure = failure ? failure : error;
+            readings[k].capacity = -1;
+        } else if (readings[k].capacity == -1) {
+            failure = failure ? failure : "⚡?";
+        } else {
+            count++;
+        }
+    }
+
+    if (!count) {
+        return strcpy(icon, failure);
+    }
+
+    for (k = 0; k < supplies->mains_count; k++) {
+        if (pread_all(supplies->mains_fds[k], buffer, sizeof(buffer)) > 0 &&
+          buffer[0] == '1') {
+            mains_online = 1;
+        }
+    }
+
+    for (k = 0; k < supplies->battery_count; k++) {
+        if (readings[k].capacity == -1) {
+            continue;
+        }
+
+        discharging |= readings[k].status == BATTERY_STATUS_DISCHARGING;
+        charging |= readings[k].status == BATTERY_STATUS_CHARGING &&
+            readings[k].capacity < 100;
+        known_status |= readings[k].status != BATTERY_STATUS_UNKNOWN;
+
+        // The weights are only comparable when they share units.
+        if (readings[k].energy[BATTERY_ENERGY_NOW] == -1 ||
+          readings[k].energy[BATTERY_ENERGY_FULL] <= 0 ||
+          (units != -1 && units != readings[k].energy_units)) {
+            units = -2;
+        } else if (units != -2) {
+            units = readings[k].energy_units;
+        }
+    }
+
+    if (discharging) {
+        trend = -1;
+    } else if (charging) {
+        trend = 1;
+    } else if (!known_status && supplies->mains_count && !mains_online) {
+        trend = -1;
+    }
+
+    for (k = 0; k < supplies->battery_count; k++) {
+        if (readings[k].capacity == -1) {
+            continue;
+        } else if (units < 0) {
+            capacity += readings[k].capacity / (double) count;
+            continue;
+        }
+
+        capacity += readings[k].capacity *
+            (double) readings[k].energy[BATTERY_ENERGY_FULL];
+        energy += readings[k].energy[BATTERY_ENERGY_NOW];
+        full += readings[k].energy[BATTERY_ENERGY_FULL];
+
+        if (readings[k].energy[BATTERY_ENERGY_RATE] > 0 &&
+          readings[k].status == (trend > 0 ? BATTERY_STATUS_CHARGING :
+          trend < 0 ? BATTERY_STATUS_DISCHARGING : BATTERY_STATUS_UNKNOWN)) {
+            rate += readings[k].energy[BATTERY_ENERGY_RATE];
+        }
+    }
+
+    if (units >= 0) {
+        capacity /= full;
+    }
+
+    // Readings taken moments apart are not as representative as ones taken
+    // minutes apart, so the weight of a new rate depends on its age.
+    if (!trend || rate <= 0) {
+        supplies->rate = 0;
+    } else if (supplies->rate > 0 && supplies->rate_trend == trend) {
+        elapsed = now > supplies->rate_updated ?
+            (double) (now - supplies->rate_updated) : 0;
+        supplies->rate += (rate - supplies->rate) *
+            (1 - exp(-elapsed / POWER_RATE_SMOOTHING_SEC));
+    } else {
+        supplies->rate = rate;
+    }
+
+    supplies->rate_trend = trend;
+    supplies->rate_updated = now;
+
+    snprintf(icon, sizeof(icon), "⚡%s%d",
+      trend > 0 ? "↑" : trend < 0 ? "↓" : "", (int) (capacity + 0.5));
+
+    if (supplies->rate > 0) {
+        minutes = lround((trend > 0 ? full - energy : energy) /
+            supplies->rate * 60);
+
+        if (minutes < POWER_ESTIMATE_LIMIT_HOURS * 60) {
+            snprintf(buffer, sizeof(buffer), " %ld:%02ld", minutes / 60,
+              minutes % 60);
+            strcat(icon, buffer);
+        }
+    }
+
+    return icon;
+}
+
+/**
+ * Signal handler that sets the global flag that indicates updates should
+ * temporarily be paused.
+ */
+static void set_pause_updates(int _1, siginfo_t *_2, void *_3)
+{
+    (void) _1;
+    (void) _2;
+    (void) _3;
+
+    pause_updates = 1;
+}
+
+#ifdef __linux__
+/**
+ * Arm a timer file descriptor so it expires at the turn of every second of
+ * the system clock. The timer is cancelled when the system clock is set, and
+ * read(2) then fails with ECANCELED until the timer is armed again.
+ *
+ * Arguments:
+ * - fd: Timer file descriptor created with CLOCK_REALTIME.
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int arm_tick_timer(int fd)
+{
+    struct itimerspec spec = {.it_interval = {.tv_sec = 1}};
+
+    if (clock_gettime(CLOCK_REALTIME, &spec.it_value)) {
+        return -1;
+    }
+
+    spec.it_value.tv_sec++;
+    spec.it_value.tv_nsec = 0;
+
+    return timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+      &spec, NULL);
+}
+#endif
+
+#ifdef __linux__
+/**
+ * Open a socket that receives the uevents broadcast by the kernel.
+ *
+ * Return: A non-blocking socket or -1 if it could not be opened.
+ */
+static int open_uevent_socket(void)
+{
+    int fd;
+
+    struct sockaddr_nl address = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = 1,
+    };
+
+    if ((fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+      NETLINK_KOBJECT_UEVENT)) == -1) {
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address))) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Read every pending uevent from a socket. Each uevent is a datagram
+ * consisting of a header like "change@/devices/..." followed by
+ * null-terminated "KEY=VALUE" pairs.
+ *
+ * Arguments:
+ * - fd: Socket returned by "open_uevent_socket". Any other datagram socket
+ *   can be used for testing.
+ *
+ * Return: UEVENT_POWER_SUPPLY if any of the uevents came from the
+ * power_supply subsystem combined with UEVENT_POWER_SUPPLY_HOTPLUG if any of
+ * those announced that a power supply was added or removed. When no uevents
+ * came from that subsystem, 0 is returned. If uevents were dropped because
+ * the socket's receive buffer overflowed, both flags are returned since any
+ * of them may have announced a new power supply.
+ */
+static int read_uevents(int fd)
+{
+    char buffer[8192];
+    int events;
+    const char *field;
+    socklen_t length;
+    ssize_t size;
+    struct sockaddr_storage source;
+
+    int power_supply = 0;
+
+    while (1) {
+        length = sizeof(source);
+
+        if ((size = recvfrom(fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT,
+          (struct sockaddr *) &source, &length)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == ENOBUFS) {
+                return UEVENT_POWER_SUPPLY | UEVENT_POWER_SUPPLY_HOTPLUG;
+            }
+
+            return power_supply;
+        }
+
+        // Netlink messages that were not sent by the kernel are ignored.
+        if (length >= sizeof(struct sockaddr_nl) &&
+          source.ss_family == AF_NETLINK &&
+          ((struct sockaddr_nl *) &source)->nl_pid != 0) {
+            continue;
+        }
+
+        buffer[size] = '\0';
+
+        for (events = 0, field = buffer; field < buffer + size;
+          field += strlen(field) + 1) {
+            if (!strcmp(field, "SUBSYSTEM=power_supply")) {
+                events |= UEVENT_POWER_SUPPLY;
+            } else if (!strcmp(field, "ACTION=add") ||
+              !strcmp(field, "ACTION=remove")) {
+                events |= UEVENT_POWER_SUPPLY_HOTPLUG;
+            }
+        }
+
+        if (events & UEVENT_POWER_SUPPLY) {
+            power_supply |= events;
+        }
+    }
+}
+
+/**
+ * Watch the directory containing the status file for the file being
+ * replaced, written or removed. The directory is watched instead of the file
+ * itself since the file is expected to be replaced with rename(2), which
+ * would leave a watch on the file pointing at the old inode. Symbolic links
+ * are not followed, so they are not watched.
+ *
+ * Arguments:
+ * - path: Path of the status file.
+ *
+ * Return: A non-blocking inotify file descriptor or -1 if the directory
+ * could not be watched.
+ */
+static int open_status_file_watch(const char *path)
+{
+    char directory[4096];
+    int fd;
+    struct stat status;
+
+    if ((!lstat(path, &status) && S_ISLNK(status.st_mode)) ||
+      strlen(path) >= sizeof(directory)) {
+        return -1;
+    }
+
+    if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        return -1;
+    }
+
+    if (inotify_add_watch(fd, dirname(strcpy(directory, path)),
+      IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM |
+      IN_ONLYDIR) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Read every pending event from an inotify file descriptor returned by
+ * "open_status_file_watch".
+ *
+ * Arguments:
+ * - fd: Inotify file descriptor.
+ * - name: Base name of the status file.
+ *
+ * Return: STATUS_FILE_CHANGED if any of the events involved the status file
+ * or events were lost, STATUS_FILE_UNWATCHED if the directory is no longer
+ * watched and 0 otherwise.
+ */
+static int read_status_file_events(int fd, const char *name)
+{
+    const struct inotify_event *event;
+    const char *cursor;
+    ssize_t size;
+
+    // The union aligns the buffer for the events.
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+
+    int changed = 0;
+
+    while (1) {
+        if ((size = read(fd, buffer.bytes, sizeof(buffer))) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return changed;
+        }
+
+        for (cursor = buffer.bytes; cursor < buffer.bytes + size;
+          cursor += sizeof(*event) + event->len) {
+            event = (const struct inotify_event *) cursor;
+
+            if (event->mask & (IN_IGNORED | IN_UNMOUNT)) {
+                changed |= STATUS_FILE_CHANGED | STATUS_FILE_UNWATCHED;
+            } else if ((event->mask & IN_Q_OVERFLOW) ||
+              (event->len && !strcmp(event->name, name))) {
+                changed |= STATUS_FILE_CHANGED;
+            }
+        }
+    }
+}
+#endif
+
+/**
+ * Discard everything that can be read from a non-blocking pipe.
+ *
+ * Arguments:
+ * - fd: Read end of the pipe.
+ */
+static void drain_pipe(int fd)
+{
+    char buffer[64];
+    ssize_t size;
+
+    while ((size = read(fd, buffer, sizeof(buffer))) > 0 ||
+      (size == -1 && errno == EINTR));
+}
+
+/**
+ * Wait for the source worker to publish its first snapshot so the first line
+ * includes the status file and the batteries. A source that is slow to read
+ * only delays the first line by FIRST_SNAPSHOT_TIMEOUT_SEC, and its text is
+ * shown once the worker publishes it.
+ *
+ * Arguments:
+ * - wake_fd: Read end of the pipe the source worker writes to.
+ */
+static void wait_for_first_snapshot(int wake_fd)
+{
+    fd_set fds;
+    struct timeval tv = {
+        .tv_sec = (time_t) FIRST_SNAPSHOT_TIMEOUT_SEC,
+        .tv_usec = (long) (FIRST_SNAPSHOT_TIMEOUT_SEC * 1e6) % 1000000,
+    };
+
+    FD_ZERO(&fds);
+    FD_SET(wake_fd, &fds);
+    select(wake_fd + 1, &fds, NULL, NULL, &tv);
+}
+
+/**
+ * Wait until the status line should be redrawn: at the turn of the next
+ * second, when the system clock is set, when the source worker publishes a
+ * snapshot or when a pause requested with PAUSE_SIGNAL ends. Every pause
+ * signal suppresses updates for PAUSE_DURATION_SEC.
+ *
+ * Arguments:
+ * - tick_timer: Timer file descriptor armed with "arm_tick_timer" or -1 if
+ *   the turn of the second should be computed with clock_gettime(3) instead.
+ *   Clock changes are only detected when a timer is used.
+ * - wake_fd: Non-blocking read end of the pipe the source worker writes to
+ *   when it publishes a snapshot or -1.
+ * - sigmask: Signal mask used while waiting. PAUSE_SIGNAL should be blocked
+ *   at all other times so it cannot arrive between checking for a pause and
+ *   waiting.
+ *
+ * Return: 1 if a snapshot was published while waiting and 0 otherwise.
+ */
+static int wait_for_tick(int tick_timer, int wake_fd, const sigset_t *sigmask)
+{
+    fd_set fds;
+    int nfds;
+    struct timespec now;
+    struct timespec pause_end;
+    int ready;
+    int tick;
+    struct timespec timeout;
+    struct timespec *timeoutp;
+
+    int paused = 0;
+    int woken = 0;
+
+    while (1) {
+        if (pause_updates) {
+            pause_updates = 0;
+            paused = 1;
+            clock_gettime(CLOCK_MONOTONIC, &pause_end);
+            pause_end.tv_sec += (time_t) PAUSE_DURATION_SEC;
+            pause_end.tv_nsec += (long) (PAUSE_DURATION_SEC * 1e9) %
+                1000000000;
+
+            if (pause_end.tv_nsec >= 1000000000) {
+                pause_end.tv_sec++;
+                pause_end.tv_nsec -= 1000000000;
+            }
+        }
+
+        timeoutp = NULL;
+
+        if (tick_timer == -1) {
+            clock_gettime(CLOCK_REALTIME, &now);
+            timeout.tv_sec = 0;
+            timeout.tv_nsec = 1000000000 - now.tv_nsec;
+            timeoutp = &timeout;
+        }
+
+        if (paused) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            now.tv_sec = pause_end.tv_sec - now.tv_sec;
+
+            if ((now.tv_nsec = pause_end.tv_nsec - now.tv_nsec) < 0) {
+                now.tv_sec--;
+                now.tv_nsec += 1000000000;
+            }
+
+            if (now.tv_sec < 0) {
+                return woken;
+            } else if (!timeoutp || now.tv_sec < timeout.tv_sec ||
+              (now.tv_sec == timeout.tv_sec &&
+              now.tv_nsec < timeout.tv_nsec)) {
+                timeout = now;
+                timeoutp = &timeout;
+            }
+        }
+
+        FD_ZERO(&fds);
+        nfds = 0;
+
+        if (tick_timer != -1) {
+            FD_SET(tick_timer, &fds);
+            nfds = tick_timer + 1;
+        }
+
+        if (wake_fd != -1) {
+            FD_SET(wake_fd, &fds);
+            nfds = wake_fd >= nfds ? wake_fd + 1 : nfds;
+        }
+
+        if ((ready = pselect(nfds, &fds, NULL, NULL, timeoutp,
+          sigmask)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return woken;
+        }
+
+        // Without a timer, the timeout is the turn of the second.
+        tick = !ready;
+
+#ifdef __linux__
+        // When the system clock is set, e.g. by NTP or after resuming from
+        // suspension, the timer must be re-aligned, and the clock is redrawn
+        // right away instead of at the next tick.
+        if (tick_timer != -1 && FD_ISSET(tick_timer, &fds)) {
+            uint64_t expirations;
+
+            if (read(tick_timer, &expirations, sizeof(expirations)) == -1 &&
+              errno == ECANCELED) {
+                arm_tick_timer(tick_timer);
+            }
+
+            tick = 1;
+        }
+#endif
+
+        if (wake_fd != -1 && FD_ISSET(wake_fd, &fds)) {
+            drain_pipe(wake_fd);
+            woken = 1;
+        }
+
+        if (!paused && (tick || woken)) {
+            return woken;
+        }
+    }
+}
+
+/**
+ * Wait for the sources refreshed by the source worker to change.
  *
  * Arguments:
- * - dest: The result will written to this character array.
- * - sizeofdest: Size of the result buffer.
- * - format: Format string as defined for _strftime(3)_.
- * - when: Unix timestamp representing the time to be formatted.
- * - where: Time zone in which the conversion takes place e.g.
- *   "America/Las_Angeles".
+ * - uevent_socket: Socket returned by "open_uevent_socket" or -1.
+ * - status_watch: File descriptor returned by "open_status_file_watch" or -1.
+ * - status_name: Base name of the status file.
+ * - timeout: Most seconds to wait or -1 to wait indefinitely.
  *
- * Return: Number of bytes written to "dest" excluding the null byte.
+ * Return: The flags returned by "read_uevents" and "read_status_file_events"
+ * for the events that were received or 0 if there were none.
  */
-static size_t tzstrftime(char *dest, size_t sizeofdest, const char *format,
-  time_t when, const char *where)
+static int wait_for_sources(int uevent_socket, int status_watch,
+  const char *status_name, time_t timeout)
 {
-    char original_tz_value[1024];
-    const struct tm *timespec;
-    const char *tz;
+    fd_set fds;
+    int ready;
+    struct timeval tv;
 
-    size_t rval = 0;
-    int saved_errno = 0;
+    int events = 0;
+    int nfds = 0;
 
-    if ((strlen(where) + 1) > sizeof(original_tz_value)) {
-        errno = EOVERFLOW;
-        return 0;
-    }
+    FD_ZERO(&fds);
 
-    if ((tz = getenv("TZ"))) {
-        strncpy(original_tz_value, tz, sizeof(original_tz_value));
+    if (uevent_socket != -1) {
+        FD_SET(uevent_socket, &fds);
+        nfds = uevent_socket + 1;
+    }
 
-        if (original_tz_value[sizeof(original_tz_value) - 1] != '\0') {
-            errno = EOVERFLOW;
-            return 0;
-        }
+    if (status_watch != -1) {
+        FD_SET(status_watch, &fds);
+        nfds = status_watch >= nfds ? status_watch + 1 : nfds;
     }
 
-    if (setenv("TZ", where, 1)) {
+    tv.tv_sec = timeout;
+    tv.tv_usec = 0;
+
+    if ((ready = select(nfds, &fds, NULL, NULL, timeout == -1 ? NULL : &tv))
+      <= 0) {
         return 0;
     }
 
-    timespec = localtime(&when);
-    saved_errno = errno;
-
-    if (timespec) {
-        if ((rval = strftime(dest, sizeofdest, format, timespec))) {
-            gmt_to_utc(dest);
-        } else {
-            saved_errno = errno;
-        }
+#ifdef __linux__
+    if (uevent_socket != -1 && FD_ISSET(uevent_socket, &fds)) {
+        events |= read_uevents(uevent_socket);
     }
 
-    if (tz) {
-        setenv("TZ", original_tz_value, 1);
-    } else {
-        unsetenv("TZ");
+    if (status_watch != -1 && FD_ISSET(status_watch, &fds)) {
+        events |= read_status_file_events(status_watch, status_name);
     }
+#else
+    (void) status_name;
+#endif
 
-    tzset();
-    errno = saved_errno;
-    return rval;
+    return events;
 }
 
 /**
- * Write the day of the week and an ordinal day of the month to "dest" e.g.
- * "Wed. the 21st."
+ * Refresh the text of the sources that may have changed.
  *
  * Arguments:
- * - dest: The string will be written to this character array.
- * - sizeofdest: Size of "dest".
- * - tm: Time structure representing the date to be displayed.
+ * - sources
+ * - events: Flags returned by "wait_for_sources".
  *
- * Return: Number of bytes written to "dest" not including the null byte.
+ * Return: 1 if the text of any source changed or the sources were loaded for
+ * the first time and 0 otherwise.
  */
-static size_t dow_with_ordinal_dom(char *dest, size_t sizeofdest,
-  struct tm *tm)
+static int refresh_sources(sources_st *sources, int events)
 {
-    size_t k;
-    char *cursor = dest;
+    double mt;
+    time_t now;
+    const char *power_text;
+    source_snapshot_st refreshed;
+
+    int reload = 0;
+    power_supplies_st *power_supplies = &sources->power_supplies;
+
+    now = time(NULL);
+    refreshed = sources->current;
+
+    // Since the refresh times are derived from the clock, the battery is
+    // also refreshed when the clock goes backwards.
+    if ((power_supplies->directory || power_supplies->battery_count) &&
+      (!sources->loaded || (events & UEVENT_POWER_SUPPLY) ||
+      now >= sources->battery_expires ||
+      now < sources->battery_expires - sources->battery_interval)) {
+        if (events & UEVENT_POWER_SUPPLY_HOTPLUG) {
+            power_supplies->stale = 1;
+        }
 
-    // The "xx" reserve spaces for the ordinal indicator so strftime will fail
-    // if the destination array is too small.
-    if (!(k = strftime(dest, sizeofdest, "%a. the %dxx", tm))) {
-        return 0;
+        power_text = power_supply_indicator(power_supplies, now);
+        snprintf(refreshed.battery, sizeof(refreshed.battery), "%s%s",
+          power_text, *power_text ? SEPARATOR : "");
+        sources->battery_expires = now - now % sources->battery_interval +
+            sources->battery_interval;
     }
 
-    cursor += k - 2;
+    if (sources->status_file && sources->status_watch != -1) {
+        reload = !sources->loaded || (events & STATUS_FILE_CHANGED);
 
-    // Remove leading 0 from day of month. Some strftime implementations
-    // support "%-d" to achieve this, but it is not part of the ISO C99
-    // standard.
-    if (tm->tm_mday < 10) {
-        *(cursor - 2) = *(cursor - 1);
-        cursor--;
+        // Once the directory is gone, the mtime is checked instead.
+        if (events & STATUS_FILE_UNWATCHED) {
+            close(sources->status_watch);
+            sources->status_watch = -1;
+        }
+    } else if (sources->status_file &&
+      (mt = mtime(sources->status_file)) != sources->status_file_mt) {
+        sources->status_file_mt = mt;
+        reload = 1;
     }
 
-    if (tm->tm_mday == 11 || tm->tm_mday == 12 || tm->tm_mday == 13) {
-        cursor = stpcpy(cursor, "th");
-    } else {
-        switch (tm->tm_mday % 10) {
-          case 1:
-            cursor = stpcpy(cursor, "st");
-            break;
-          case 2:
-            cursor = stpcpy(cursor, "nd");
-            break;
-          case 3:
-            cursor = stpcpy(cursor, "rd");
-            break;
-          default:
-            cursor = stpcpy(cursor, "th");
-            break;
+    if (reload) {
+        refreshed.status_file[0] = '\0';
+
+        if (!load_indicators_from_file(refreshed.status_file,
+          sizeof(refreshed.status_file), sources->status_file, SEPARATOR) &&
+          errno) {
+            perror(sources->status_file);
         }
     }
 
-    return (size_t) (cursor - dest);
+    // The first refresh always counts as a change, even when every source is
+    // empty, so the main thread is not left waiting for a first snapshot.
+    if (sources->loaded &&
+      !strcmp(refreshed.battery, sources->current.battery) &&
+      !strcmp(refreshed.status_file, sources->current.status_file)) {
+        return 0;
+    }
+
+    sources->loaded = 1;
+    sources->current = refreshed;
+    return 1;
 }
 
 /**
- * Return a string representing the state of the battery. There are several
- * different states states (the XX below represents the charge percentage):
- *
- * - `⚡-`: Shown when the file containing the battery data could not be opened.
- * - `⚡↑XX`: Shown when the battery is charging.
- * - `⚡↓XX`: Shown when the battery is draining.
- * - `⚡XX`: Shown when the battery is not draining or charging.
- * - `⚡?`: Shown when the file containing the battery data could not be parsed
- *   because the format was not recognized.
- * - `⚡!`: Shown when there was an error reading the battery data file.
+ * Replace the pending snapshot of the sources.
  *
  * Arguments:
- * - path: Path to the file containing the battery data in the form of a uevent
- *   sysfs battery node e.g. "/sys/class/power_supply/BAT0/uevent".
+ * - sources
+ * - snapshot: New pending snapshot or NULL.
  *
- * Return: A pointer to a statically allocated array containing the indicator
- * text.
+ * Return: The snapshot that was pending or NULL. The caller is responsible
+ * for freeing it.
  */
-static char *battery_indicator(const char *path)
+static source_snapshot_st *exchange_snapshot(sources_st *sources,
+  source_snapshot_st *snapshot)
 {
-    char *endptr;
-    FILE *file;
-    long int long_int;
-    char *match;
+    source_snapshot_st *previous;
 
-    size_t bufsize = 0;
-    int capacity_percent = -1;
-    static char icon[16] = "";
-    char *line = NULL;
-    signed char trend = 0;
+    pthread_mutex_lock(&sources->lock);
+    previous = sources->pending;
+    sources->pending = snapshot;
+    pthread_mutex_unlock(&sources->lock);
 
-    while (!(file = fopen(path, "r"))) {
-        if (errno != EINTR) {
-            return strcpy(icon, "⚡-");
-        }
-    }
+    return previous;
+}
 
-    while (getline(&line, &bufsize, file) != -1) {
-        if ((match = strstr(line, "POWER_SUPPLY_CAPACITY="))) {
-            match += sizeof("POWER_SUPPLY_CAPACITY=") - 1;
-            errno = 0;
-            long_int = strtol(match, &endptr, 10);
+/**
+ * Publish a snapshot of the current text of the sources then wake the main
+ * thread. A snapshot the main thread has not taken yet is discarded.
+ *
+ * Arguments:
+ * - sources
+ */
+static void publish_sources(sources_st *sources)
+{
+    source_snapshot_st *snapshot;
 
-            if (!errno && endptr != match && long_int >= 0 && long_int < 101) {
-                capacity_percent = (int) long_int;
-            }
-        } else if (strstr(line, "POWER_SUPPLY_STATUS=Charging")) {
-            trend = +1;
-        } else if (strstr(line, "POWER_SUPPLY_STATUS=Discharging")) {
-            trend = -1;
-        }
+    if (!(snapshot = malloc(sizeof(*snapshot)))) {
+        perror("malloc");
+        return;
     }
 
-    free(line);
+    *snapshot = sources->current;
+    free(exchange_snapshot(sources, snapshot));
 
-    if (capacity_percent == -1) {
-        if (feof(file)) {
-            strcpy(icon, "⚡?");
-        } else {
-            strcpy(icon, "⚡!");
-        }
-    } else if (trend > 0 && capacity_percent < 100) {
-        snprintf(icon, sizeof(icon), "⚡↑%d", capacity_percent);
-    } else if (trend < 0) {
-        snprintf(icon, sizeof(icon), "⚡↓%d", capacity_percent);
-    } else {
-        snprintf(icon, sizeof(icon), "⚡%d", capacity_percent);
+    if (sources->notify_fd != -1) {
+        while (write(sources->notify_fd, "", 1) == -1 && errno == EINTR);
     }
-
-    fclose(file);
-    return icon;
 }
 
 /**
- * Signal handler that sets the global flag that indicates updates should
- * temporarily be paused.
+ * Body of the source worker thread. The sources are refreshed whenever they
+ * change and whenever the battery or the mtime of the status file must be
+ * polled.
+ *
+ * Arguments:
+ * - argument: The sources_st that is refreshed.
+ *
+ * Return: This function never returns.
  */
-static void set_pause_updates(int _1, siginfo_t *_2, void *_3)
+static void *run_source_worker(void *argument)
 {
-    (void) _1;
-    (void) _2;
-    (void) _3;
+    time_t timeout;
 
-    pause_updates = 1;
+    int events = 0;
+    sources_st *sources = argument;
+
+    while (1) {
+        if (refresh_sources(sources, events)) {
+            publish_sources(sources);
+        }
+
+        if (sources->status_file && sources->status_watch == -1) {
+            timeout = 1;
+        } else if (sources->power_supplies.directory ||
+          sources->power_supplies.battery_count) {
+            timeout = sources->battery_expires - time(NULL);
+            timeout = timeout < 1 ? 1 : timeout > sources->battery_interval ?
+                sources->battery_interval : timeout;
+        } else {
+            timeout = -1;
+        }
+
+        events = wait_for_sources(sources->uevent_socket,
+          sources->status_watch, sources->status_name, timeout);
+    }
+
+    return NULL;
 }
 
 /**
@@ -530,11 +2896,44 @@ static double moon_phase(time_t when)
     return bound_angle(lPP - lambda_sun) / 360;
 }
 
+/**
+ * Determine which icon and marker describe the phase of the moon at a given
+ * time. Within 12 hours of a new moon or full moon, the moon is marked as
+ * waxing or waning.
+ *
+ * Arguments:
+ * - when: UNIX timestamp representing the time.
+ *
+ * Return: The moon phase (a moon_phase_et) multiplied by 3 plus 1 if the moon
+ * is marked as waxing or 2 if it is marked as waning.
+ */
+static int moon_state(time_t when)
+{
+    double phase = moon_phase(when);
+    int icon = (int) (phase * 8 + 0.5) % 8;
+
+    double t_minus_12h = moon_phase(when - 43200);
+    double t_plus_12h = moon_phase(when + 43200);
+
+    if ((phase <= 0.5 && 0.5 <= t_plus_12h) || t_minus_12h > phase) {
+        return icon * 3 + 1;
+    } else if ((t_minus_12h <= 0.5 && 0.5 <= phase) || t_plus_12h < phase) {
+        return icon * 3 + 2;
+    }
+
+    return icon * 3;
+}
+
 /**
  * Return a string indicating the phase of the moon. Within 12 hours of a new
  * moon or full moon, a "⁺" is prepended to the icon if the moon is waxing, and
  * a "⁻" if the moon is waning.
  *
+ * The moon phase calculations are fairly expensive, so the instants at which
+ * the string changes are computed for one lunation ahead of time and cached.
+ * They are only recomputed when those instants have passed or "when" precedes
+ * the cached range e.g. because the clock was set.
+ *
  * Arguments:
  * - when: UNIX timestamp representing the time.
  * - southern_hemisphere: When this is 0, the icon fills right-to-left as the
@@ -547,10 +2946,13 @@ static double moon_phase(time_t when)
  *   inverted. This is useful when the foreground and background colors used to
  *   display monochrome moon phase icons produce unintuitive pictures when
  *   using the correct characters.
+ * - expires: When this is not NULL, the UNIX timestamp at which the returned
+ *   string is next subject to change is stored here.
  *
  * Return: An icon representing the current moon phase.
  */
-const char *moon_icon(time_t when, int southern_hemisphere, int invert)
+const char *moon_icon(time_t when, int southern_hemisphere, int invert,
+  time_t *expires)
 {
     static const char *icons[MOON_PHASE_COUNT] = {
         [MOON_PHASE_NEW_MOON] =        "🌑",
@@ -563,22 +2965,71 @@ const char *moon_icon(time_t when, int southern_hemisphere, int invert)
         [MOON_PHASE_WANING_CRESCENT] = "🌘",
     };
 
+    // Length of a synodic month rounded up to the nearest second.
+    static const time_t lunation = 2551443;
+
+    // The icon and the markers each stay the same for at least several hours,
+    // so no more than one change can happen within a search step.
+    static const time_t search_step = 1800;
+
+    static size_t count = 0;
+    static size_t current = 0;
+    static time_t end = 0;
+    static int states[32];
+    static time_t starts[ARRAY_LENGTH(states)];
     static char text[8] = "";
 
-    double phase = moon_phase(when);
-    int icon = (int) (phase * 8 + 0.5) % 8;
+    int icon;
+    time_t lower;
+    time_t middle;
+    time_t step_end;
+    time_t upper;
+
+    if (!count || when < starts[0] || when >= end) {
+        starts[0] = when;
+        states[0] = moon_state(when);
+        count = 1;
+        current = 0;
+
+        // Walk through the next lunation, and use a binary search to find the
+        // first second of each new state.
+        for (end = when; end < when + lunation &&
+          count < ARRAY_LENGTH(states); end = step_end) {
+            step_end = end + search_step;
+
+            if (moon_state(step_end) == states[count - 1]) {
+                continue;
+            }
 
-    double t_minus_12h = moon_phase(when - 43200);
-    double t_plus_12h = moon_phase(when + 43200);
+            for (lower = end, upper = step_end; upper - lower > 1; ) {
+                middle = lower + (upper - lower) / 2;
 
-    if ((phase <= 0.5 && 0.5 <= t_plus_12h) || t_minus_12h > phase) {
-        strcpy(text, "⁺");
-    } else if ((t_minus_12h <= 0.5 && 0.5 <= phase) || t_plus_12h < phase) {
-        strcpy(text, "⁻");
-    } else {
-        text[0] = '\0';
+                if (moon_state(middle) == states[count - 1]) {
+                    lower = middle;
+                } else {
+                    upper = middle;
+                }
+            }
+
+            starts[count] = upper;
+            states[count++] = moon_state(upper);
+        }
+    }
+
+    while (current > 0 && when < starts[current]) {
+        current--;
+    }
+
+    while (current + 1 < count && when >= starts[current + 1]) {
+        current++;
+    }
+
+    if (expires) {
+        *expires = current + 1 < count ? starts[current + 1] : end;
     }
 
+    icon = states[current] / 3;
+
     if (invert) {
         // Treat the new moon icon as the full moon icon and vice versa.
         icon = (icon + 4) % 8;
@@ -590,6 +3041,8 @@ const char *moon_icon(time_t when, int southern_hemisphere, int invert)
         icon = (8 - icon) % 8;
     }
 
+    strcpy(text, states[current] % 3 == 1 ? "⁺" :
+      states[current] % 3 == 2 ? "⁻" : "");
     return strcat(text, icons[icon]);
 }
 
@@ -604,21 +3057,22 @@ const char *moon_icon(time_t when, int southern_hemisphere, int invert)
  */
 static time_t round_down_to_midnight(time_t when)
 {
-    char buf[20];
-    struct tm *in;
-    struct tm out;
+    struct tm tm;
 
     when -= when % 60;
-    in = localtime(&when);
+    localtime_r(&when, &tm);
 
-    if (in->tm_hour == 0 && in->tm_min == 0) {
+    if (tm.tm_hour == 0 && tm.tm_min == 0) {
         return when;
     }
 
-    sprintf(buf, "%d-%02d-%02d 00:00:00", in->tm_year + 1900, in->tm_mon + 1,
-        in->tm_mday);
-    strptime(buf, "%Y-%m-%d %H:%M:%S", &out);
-    return mktime(&out);
+    // mktime(3) must work out whether daylight saving time is in effect at
+    // midnight since it may differ from the current time.
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
 }
 
 /**
@@ -684,30 +3138,23 @@ static void sunrise_sunset_times(time_t when, double latitude,
 }
 
 /**
- * Return a string showing when the next sunrise or sunset takes place.
+ * Determine when the next sunrise or sunset takes place.
  *
  * Arguments:
- * - when: A UNIX timestamp representing the day for which to compute the
- *   sunset and sunrise.
+ * - when: A UNIX timestamp representing the current time.
  * - latitude: The latitude of the location in degrees.
  * - longitude: The longitude of the location in degrees.
- * - sunrise: Location at which the computed sunrise time is stored. This can
- *   be NULL if the caller does not want the value.
- * - sunset: Location at which the computed sunset time is stored. This can be
- *   NULL if the caller does not want the value.
+ * - is_sunrise: Output pointer set to 1 if the next event is a sunrise and 0
+ *   if it is a sunset.
+ *
+ * Return: UNIX timestamp of the next event.
  */
-static char *sunrise_sunset_info(time_t when, double latitude,
-  double longitude)
+static time_t next_sunrise_or_sunset(time_t when, double latitude,
+  double longitude, int *is_sunrise)
 {
-    const char *format;
     time_t midnight;
     time_t sunrise;
     time_t sunset;
-    static char text[64];
-    time_t timestamp;
-
-    const char sunrise_format[] = "🌅 %R";
-    const char sunset_format[] = "🌙 %R";
 
     midnight = round_down_to_midnight(when);
     sunrise_sunset_times(midnight, latitude, longitude, &sunrise, &sunset);
@@ -719,19 +3166,84 @@ static char *sunrise_sunset_info(time_t when, double latitude,
         // dramatic changes in time zones.
         midnight = round_down_to_midnight(midnight + 36 * 3600);
         sunrise_sunset_times(midnight, latitude, longitude, &sunrise, NULL);
+        *is_sunrise = 1;
+        return sunrise;
+    }
 
-        timestamp = sunrise;
-        format = sunrise_format;
-    } else if (sunrise > when) {
-        timestamp = sunrise;
-        format = sunrise_format;
-    } else {
-        timestamp = sunset;
-        format = sunset_format;
+    *is_sunrise = sunrise > when;
+    return *is_sunrise ? sunrise : sunset;
+}
+
+/**
+ * Identify the local day containing a given time. This subtracts the time of
+ * day from the timestamp, so on days with a daylight saving time transition,
+ * the result is not necessarily midnight, but it changes whenever the date or
+ * UTC offset does.
+ *
+ * Arguments:
+ * - when: UNIX timestamp.
+ *
+ * Return: A UNIX timestamp identifying the day or 0 if the local time could
+ * not be determined.
+ */
+static time_t local_day(time_t when)
+{
+    struct tm tm;
+
+    if (!localtime_r(&when, &tm)) {
+        return 0;
+    }
+
+    return when - (tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec);
+}
+
+/**
+ * Return a string showing when the next sunrise or sunset takes place. The
+ * string only changes when that event passes, the local date changes or the
+ * UTC offset changes either now or at the time of the event, so it is cached
+ * until one of those things happens.
+ *
+ * Arguments:
+ * - when: A UNIX timestamp representing the current time.
+ * - latitude: The latitude of the location in degrees.
+ * - longitude: The longitude of the location in degrees.
+ * - expires: When this is not NULL, the UNIX timestamp of the event shown in
+ *   the string is stored here.
+ *
+ * Return: A string describing the next event.
+ */
+static char *sunrise_sunset_info(time_t when, double latitude,
+  double longitude, time_t *expires)
+{
+    static time_t computed_at;
+    static time_t event;
+    static double event_latitude;
+    static double event_longitude;
+    static time_t event_day;
+    static time_t today;
+    static char text[64] = "";
+
+    int is_sunrise;
+
+    if (!text[0] || when >= event || when < computed_at ||
+      latitude != event_latitude || longitude != event_longitude ||
+      today != local_day(when) || event_day != local_day(event)) {
+        event = next_sunrise_or_sunset(when, latitude, longitude,
+            &is_sunrise);
+        computed_at = when;
+        event_latitude = latitude;
+        event_longitude = longitude;
+        today = local_day(when);
+        event_day = local_day(event);
+
+        if (!strftime(text, sizeof(text), is_sunrise ? "🌅 %R" : "🌙 %R",
+          localtime(&event))) {
+            strncpy(text, "⚠️", sizeof(text));
+        }
     }
 
-    if (!strftime(text, sizeof(text), format, localtime(&timestamp))) {
-        strncpy(text, "⚠️", sizeof(text));
+    if (expires) {
+        *expires = event;
     }
 
     return text;
@@ -917,9 +3429,19 @@ static void usage(const char *self)
         "Options:\n"
         "  -1       Print one status line and exit without setting the X11\n"
         "           root window name.\n"
-        "  -b PATH  Path to uevent battery data. When unset, this defaults\n"
-        "           \"/sys/class/power_supply/BAT0/uevent\" if it that path\n"
-        "           can be read during program initialization.\n"
+        "  -b PATH  Path to uevent battery data or a directory containing\n"
+        "           a subdirectory for every power supply. When unset, this\n"
+        "           defaults to \"/sys/class/power_supply\" if that path can\n"
+        "           be read during program initialization. The charge of\n"
+        "           every battery in a directory is combined, and the time\n"
+        "           until the batteries are full or empty is shown when they\n"
+        "           report their energy and power. When the \"capacity\" and\n"
+        "           \"status\" attributes exist in the same directory as a\n"
+        "           uevent file, they are read instead of the uevent file.\n"
+        "           On Linux, the battery status is refreshed as soon as the\n"
+        "           kernel reports a power supply change, and the power\n"
+        "           supplies are enumerated again when one is added or\n"
+        "           removed.\n"
         "  -c COORDINATES\n"
         "           Show sunrise and sunset times for the given longitude\n"
         "           and latitude which are specified as two numbers\n"
@@ -943,14 +3465,16 @@ static void usage(const char *self)
         "  -n       Force dry run; do not set the X11 root window name even\n"
         "           if stdout is not a TTY.\n"
         "  -s PATH  Load status bar indicators from this file. Each line is\n"
-        "           treated as a separate indicator. It is best to host this\n"
-        "           this file on a fast filesystem (tmpfs, ramfs, etc.) to\n"
-        "           reduce the likelihood of disk latency slowing down the\n"
-        "           clock. The file is only re-read when the mtime changes.\n"
-        "           Any updates to this file should be done in an atomic\n"
-        "           manner i.e. rename(2) on most Unix filesystems. If the\n"
-        "           size of the file exceeds approximately 1KiB, text may be\n"
-        "           discarded or truncated.\n"
+        "           treated as a separate indicator. The file is read by a\n"
+        "           separate thread, so a slow filesystem delays the\n"
+        "           indicators but not the clock. On Linux, the directory\n"
+        "           containing the file is watched, and the file is re-read\n"
+        "           as soon as it is replaced or written. Otherwise, or when\n"
+        "           the file is a symbolic link, it is only re-read when the\n"
+        "           mtime changes. Any updates to this file should be done\n"
+        "           in an atomic manner i.e. rename(2) on most Unix\n"
+        "           filesystems. If the size of the file exceeds\n"
+        "           approximately 1KiB, text may be discarded or truncated.\n"
         "  -z TIMEZONE\n"
         "           Display a supplementary clock for the given time zone.\n"
         "           This flag can be specified multiple times to show\n"
@@ -962,21 +3486,12 @@ static void usage(const char *self)
         "           Clocks are shown in the order they appear on the command\n"
         "           line followed by the default clock. When different time\n"
         "           zones would result in duplicate clocks, only the first\n"
-        "           one is shown. If this option is only specified once and\n"
-        "           its value is \"XXX\", only the default clock for the\n"
-        "           local time zone is shown, but some internal changes are\n"
-        "           made to address a bug documented below.\n"
-        "\n"
-        "Bugs:\n"
-        "  On Linux with glibc, changes to the system's default time zone\n"
-        "  are reflected in calls to tzset(3) immediately, but this is not\n"
-        "  the case for OpenBSD: its implementation is somewhat lazy and\n"
-        "  will not do any further processing if the TZ environment variable\n"
-        "  has the same value it did when tzset(3) was previously called.\n"
-        "  Using \"-z\" internally changes TZ and calls tzset(3), but if the\n"
-        "  user only wants to display one clock, the reserved value \"XXX\"\n"
-        "  can be used as documented above to work around this issue on\n"
-        "  OpenBSD and any other platforms that behave similarly.\n"
+        "           one is shown. Time zones are loaded from the TZif files\n"
+        "           in TZDIR or \"" ZONEINFO_DIRECTORY "\" and reloaded\n"
+        "           whenever those files change. Values that do not name a\n"
+        "           file are parsed as POSIX TZ strings e.g. \"EST5EDT\",\n"
+        "           and anything else is displayed as UTC. The value \"XXX\"\n"
+        "           is ignored for compatibility with older versions.\n"
         ,
         self
     );
@@ -985,8 +3500,9 @@ static void usage(const char *self)
 int main(int argc, char **argv)
 {
     char altclock[64];
-    const char *altzones[8];
+    time_zone_st altzones[8];
     char *clocks;
+    indicator_st *indicator;
     size_t k;
     char localclock[64];
     char message[2048];
@@ -994,28 +3510,48 @@ int main(int argc, char **argv)
     time_t now;
     struct tm nowtm;
     int option;
+    source_snapshot_st *published;
     struct tm *ptm;
+    struct stat st;
     int saved_errno;
-    double status_file_mt_now;
+    sigset_t blocked;
     struct sigaction sa;
+    sigset_t sigmask;
     struct timeval tv;
+    int wake_pipe[2];
+    pthread_t worker;
 
     size_t altzones_count = 0;
-    const char *battery_data_path = "/sys/class/power_supply/BAT0/uevent";
-    int battery_data_path_explicit = 0;
     int first = 1;
-    char indicators_from_file[1024] = "";
+    indicator_st indicators[INDICATOR_COUNT] = {{0}};
     int invert_moon = 0;
     double latitude = 0;
+    time_zone_st local_zone = {0};
     double longitude = 0;
+    int power_supplies_explicit = 0;
+    time_t previous_now = 0;
+    int zone_changed = 0;
     int run_once = 0;
     int show_moon_phase = 0;
     int show_sunrise_sunset = 0;
+    source_snapshot_st *snapshot = NULL;
+    sources_st sources = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .notify_fd = -1,
+        .power_supplies = {
+            .directory = POWER_SUPPLY_DIRECTORY,
+            .stale = 1,
+        },
+        .battery_interval = BATTERY_REFRESH_SEC,
+        .uevent_socket = -1,
+        .status_watch = -1,
+        .status_file_mt = -1,
+    };
+    power_supplies_st *power_supplies = &sources.power_supplies;
     int southern_hemisphere = 0;
-    char *status_file = NULL;
-    double status_file_mt = -1;
+    int tick_timer = -1;
+    int wake_fd = -1;
 
-    const char *eob = message + sizeof(message);
     char *eol = message;
 
     while ((option = getopt(argc, argv, "+1b:c:hiMms:z:")) != -1) {
@@ -1025,8 +3561,18 @@ int main(int argc, char **argv)
             break;
 
           case 'b':
-            battery_data_path_explicit = 1;
-            battery_data_path = optarg;
+            power_supplies_explicit = 1;
+
+            // A directory is treated like the power supply directory, and
+            // anything else is the uevent file of a single battery.
+            if (!stat(optarg, &st) && S_ISDIR(st.st_mode)) {
+                power_supplies->directory = optarg;
+                power_supplies->battery_count = 0;
+            } else {
+                power_supplies->directory = NULL;
+                power_supplies->battery_count = 1;
+                init_battery(&power_supplies->batteries[0], optarg);
+            }
             break;
 
           case 'c':
@@ -1076,7 +3622,7 @@ int main(int argc, char **argv)
             break;
 
           case 's':
-            status_file = optarg;
+            sources.status_file = optarg;
             break;
 
           case 'z':
@@ -1086,7 +3632,18 @@ int main(int argc, char **argv)
                 return 1;
             }
 
-            altzones[altzones_count++] = optarg;
+            // A single "XXX" was once needed to work around an OpenBSD
+            // tzset(3) bug. It is still accepted for compatibility.
+            if (!strcmp(optarg, "XXX")) {
+                break;
+            }
+
+            if (load_time_zone(&altzones[altzones_count], optarg)) {
+                fprintf(stderr, "%s: unknown time zone; using UTC\n", optarg);
+                load_time_zone(&altzones[altzones_count], "UTC0");
+            }
+
+            altzones_count++;
             break;
 
           case '+':
@@ -1111,8 +3668,16 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    if (!battery_data_path_explicit && access(battery_data_path, R_OK)) {
-        battery_data_path = NULL;
+    if (!power_supplies_explicit &&
+      access(power_supplies->directory, R_OK)) {
+        power_supplies->directory = NULL;
+    }
+
+    // Like the C library, a TZ value that cannot be loaded falls back to UTC,
+    // but when there is no usable time zone information at all, localtime(3)
+    // is used instead.
+    if (load_time_zone(&local_zone, getenv("TZ")) && getenv("TZ")) {
+        load_time_zone(&local_zone, "UTC0");
     }
 
     sa.sa_flags = SA_RESTART;
@@ -1124,57 +3689,124 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    // The pause signal is only delivered while waiting for the next tick.
+    sigemptyset(&blocked);
+    sigaddset(&blocked, PAUSE_SIGNAL);
+
+    if (sigprocmask(SIG_BLOCK, &blocked, &sigmask)) {
+        perror("sigprocmask");
+        return 1;
+    }
+
+#ifdef __linux__
+    // When the kernel reports power supply changes, the battery indicator is
+    // updated as soon as they happen, and it is only polled occasionally.
+    // The power supplies are only enumerated again when one is added or
+    // removed.
+    if (!run_once && (power_supplies->directory ||
+      power_supplies->battery_count) &&
+      (sources.uevent_socket = open_uevent_socket()) != -1) {
+        sources.battery_interval = BATTERY_EVENT_REFRESH_SEC;
+    }
+
+    // When the directory containing the status file can be watched, the file
+    // is only read when it changes instead of checking its mtime every tick.
+    if (!run_once && sources.status_file) {
+        sources.status_watch = open_status_file_watch(sources.status_file);
+    }
+#endif
+
+    if (sources.status_file) {
+        sources.status_name = strrchr(sources.status_file, '/') ?
+            strrchr(sources.status_file, '/') + 1 : sources.status_file;
+    }
+
+    // The status file and the batteries are loaded by a worker thread, so
+    // the clock is drawn on time even when they are slow to read. The first
+    // line still waits briefly for them so it is normally complete. When
+    // only one line is printed, they are simply loaded up front instead.
+    if (run_once) {
+        refresh_sources(&sources, 0);
+        publish_sources(&sources);
+    } else if (sources.status_file || power_supplies->directory ||
+      power_supplies->battery_count) {
+        if (pipe(wake_pipe)) {
+            perror("pipe");
+            return 1;
+        }
+
+        for (k = 0; k < 2; k++) {
+            fcntl(wake_pipe[k], F_SETFD, FD_CLOEXEC);
+            fcntl(wake_pipe[k], F_SETFL, O_NONBLOCK);
+        }
+
+        wake_fd = wake_pipe[0];
+        sources.notify_fd = wake_pipe[1];
+
+        if ((errno = pthread_create(&worker, NULL, run_source_worker,
+          &sources))) {
+            perror("pthread_create");
+            return 1;
+        }
+
+        wait_for_first_snapshot(wake_fd);
+    }
+
+#ifdef __linux__
+    // The timer is only armed once the first snapshot has been waited for.
+    // Otherwise, a wait spanning the turn of a second would leave an
+    // expiration pending, and the first second would be drawn twice.
+    if (!run_once && (tick_timer = timerfd_create(CLOCK_REALTIME,
+      TFD_CLOEXEC)) != -1 && arm_tick_timer(tick_timer)) {
+        close(tick_timer);
+        tick_timer = -1;
+    }
+#endif
+
     while ((eol = message)) {
-        tzset();
-
-        // File I/O is handled after displaying the current time to reduce the
-        // chances of disk I/O messing with the clock's monotonicity. The down
-        // side is that the file indicators may lag behind by a couple of
-        // seconds which could be annoying.
-        if (status_file) {
-            if ((status_file_mt_now = mtime(status_file)) != status_file_mt) {
-                status_file_mt = status_file_mt_now;
-                indicators_from_file[0] = '\0';
-
-                if (status_file_mt == -1) {
-                    perror(status_file);
-                } else {
-                    load_indicators_from_file(
-                        indicators_from_file, sizeof(indicators_from_file),
-                        status_file,
-                        SEPARATOR
-                    );
-                }
-            }
+        // Time zones are only reloaded when their files change, so this only
+        // costs a stat(2) per zone. The C library's notion of the local time
+        // zone, which is used for the sunrise and sunset times, is updated at
+        // the same time.
+        if (refresh_time_zone(&local_zone)) {
+            tzset();
+            zone_changed = 1;
+        }
 
-            eol = stpcpy(eol, indicators_from_file);
+        for (k = 0; k < altzones_count; k++) {
+            refresh_time_zone(&altzones[k]);
         }
 
         // Sleep until the turn of the second. The first time the loop is
         // executed, this is step skipped because the clocks haven't been shown
-        // yet.
+        // yet. The line is also redrawn as soon as the source worker
+        // publishes a snapshot, so new indicators are shown right away.
         if (!first) {
-            gettimeofday(&tv, NULL);
-            tv.tv_sec = 0;
-            tv.tv_usec = 1000000 - tv.tv_usec;
-            select(0, NULL, NULL, NULL, &tv);
+            wait_for_tick(tick_timer, wake_fd, &sigmask);
         }
 
         first = 0;
 
-        while (pause_updates) {
-            pause_updates = 0;
-            tv.tv_sec = (time_t) PAUSE_DURATION_SEC;
-            tv.tv_usec = (suseconds_t) (PAUSE_DURATION_SEC * 1e6) % 1000000;
-            select(0, NULL, NULL, NULL, &tv);
+        // The worker never modifies a snapshot once it has been published,
+        // so the one that is displayed can be read without locking. The pipe
+        // is drained first so only snapshots published after this point wake
+        // up the loop.
+        if (wake_fd != -1) {
+            drain_pipe(wake_fd);
+        }
+
+        if ((published = exchange_snapshot(&sources, NULL))) {
+            free(snapshot);
+            snapshot = published;
         }
 
-        if (battery_data_path) {
-            eol = stpcpy(eol, battery_indicator(battery_data_path));
-            eol = stpcpy(eol, SEPARATOR);
+        if (snapshot) {
+            eol = stpcpy(eol, snapshot->status_file);
         }
 
-        if (gettimeofday(&tv, NULL) || !(ptm = localtime(&tv.tv_sec))) {
+        if (gettimeofday(&tv, NULL) || (local_zone.loaded ?
+          !time_zone_localtime(&local_zone, tv.tv_sec, &nowtm) :
+          !(ptm = localtime(&tv.tv_sec)))) {
             saved_errno = errno;
             eol = stpcpy(eol, "Unable to get time: ");
             eol = stpcpy(eol, strerror(saved_errno));
@@ -1182,19 +3814,57 @@ int main(int argc, char **argv)
         }
 
         now = tv.tv_sec;
-        nowtm = *ptm;
 
-        if (show_sunrise_sunset) {
-            eol = stpcpy(eol, sunrise_sunset_info(now, latitude, longitude));
-            eol = stpcpy(eol, SEPARATOR);
+        if (!local_zone.loaded) {
+            nowtm = *ptm;
         }
 
-        if (show_moon_phase) {
-            eol = stpcpy(eol, moon_icon(now, southern_hemisphere, invert_moon));
-            eol = stpcpy(eol, SEPARATOR);
+        // Each indicator is only regenerated when its text may have changed,
+        // so most ticks only format the clocks. Since expiration times are
+        // derived from the clock, everything is regenerated when it goes
+        // backwards or the local time zone changes.
+        if (now < previous_now || zone_changed) {
+            for (k = 0; k < INDICATOR_COUNT; k++) {
+                indicators[k].valid = 0;
+            }
+        }
+
+        previous_now = now;
+        zone_changed = 0;
+        indicator = &indicators[INDICATOR_SUNRISE_SUNSET];
+
+        // The sunrise and sunset times are recomputed when the local date or
+        // UTC offset changes and whenever the displayed event has passed.
+        if (show_sunrise_sunset && indicator_due(indicator, now, (long) (now -
+          (nowtm.tm_hour * 3600 + nowtm.tm_min * 60 + nowtm.tm_sec)))) {
+            snprintf(indicator->text, sizeof(indicator->text), "%s%s",
+              sunrise_sunset_info(now, latitude, longitude,
+                &indicator->expires), SEPARATOR);
+        }
+
+        indicator = &indicators[INDICATOR_MOON_PHASE];
+
+        if (show_moon_phase && indicator_due(indicator, now, 0)) {
+            snprintf(indicator->text, sizeof(indicator->text), "%s%s",
+              moon_icon(now, southern_hemisphere, invert_moon,
+                &indicator->expires), SEPARATOR);
+        }
+
+        indicator = &indicators[INDICATOR_DATE];
+
+        if (indicator_due(indicator, now, nowtm.tm_year * 400L +
+          nowtm.tm_yday) && !dow_with_ordinal_dom(indicator->text,
+          sizeof(indicator->text), &nowtm)) {
+            indicator->text[0] = '\0';
+        }
+
+        if (snapshot) {
+            eol = stpcpy(eol, snapshot->battery);
         }
 
-        eol += dow_with_ordinal_dom(eol, (size_t) (eob - eol + 1), &nowtm);
+        for (k = 0; k < INDICATOR_COUNT; k++) {
+            eol = stpcpy(eol, indicators[k].text);
+        }
 
         // Display clocks for any user-defined time zones that differ from the
         // clock for the environment-defined time zone. Since the time zone
@@ -1202,7 +3872,12 @@ int main(int argc, char **argv)
         // UTC offset as the local time but different names will still be shown
         // e.g. "10:10 CKT" (Cook Island Time, UTC-10) and "10:10:37 HST"
         // (Hawaii Standard Time, also UTC-10).
-        if (strftime(localclock, sizeof(localclock), "%T %Z", &nowtm)) {
+        if (local_zone.loaded) {
+            if (!tzstrftime(localclock, sizeof(localclock), "%T %Z", now,
+              &local_zone)) {
+                localclock[0] = '\0';
+            }
+        } else if (strftime(localclock, sizeof(localclock), "%T %Z", &nowtm)) {
             gmt_to_utc(localclock);
         } else {
             localclock[0] = '\0';
@@ -1211,12 +3886,8 @@ int main(int argc, char **argv)
         clocks = eol;
 
         for (multiple_clocks = 0, k = 0; k < altzones_count; k++) {
-            if (altzones_count == 1 && !strcmp("XXX", altzones[k])) {
-                tzstrftime(altclock, sizeof(altclock), "", now, altzones[k]);
-                break;
-            }
-
-            if (tzstrftime(altclock, sizeof(altclock), "%T %Z", now, altzones[k]) &&
+            if (tzstrftime(altclock, sizeof(altclock), "%T %Z", now,
+              &altzones[k]) &&
                 strcmp(altclock, localclock)) {
 
                 // Strip seconds from supplementary clock.
@@ -0,0 +1,391 @@
+/**
+ * Verify that the output of redundansi is rendered the same way as its input.
+ * The contents of "test.in" are processed with and without minification, and
+ * the results are rendered by a small model of a terminal that is independent
+ * of the one in redundansi. The model also knows attributes redundansi does
+ * not track, so attributes that are lost are detected too. A terminal should
+ * render the input and both outputs identically, and a pager, which resets
+ * the attributes at the start of each line, should render both outputs
+ * identically. The input is also fed to redundansi one byte at a time to make
+ * sure splitting the input does not change the output.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#define REDUNDANSI_NO_MAIN
+#include "../../core/utilities/redundansi.c"
+
+/**
+ * Attributes applied to a character by the terminal model. Colors and
+ * attributes without a member of their own are stored as the text of their
+ * SGR parameters.
+ */
+typedef struct {
+    int bold;
+    int faint;
+    int italic;
+    // 1 for a single underline and 2 for a double underline.
+    int underline;
+    // 1 for a slow blink and 2 for a rapid blink.
+    int blink;
+    int reverse;
+    int hidden;
+    int strike;
+    int overline;
+    char fgcolor[32];
+    char bgcolor[32];
+    char ulcolor[32];
+    char other[256];
+    char link[256];
+} rendition_st;
+
+/**
+ * Write processed data to a FILE.
+ *
+ * Arguments:
+ * - context: Pointer to a FILE.
+ * - data: Data to write.
+ * - size: Number of bytes in "data".
+ *
+ * Return: 0 on success and -1 otherwise.
+ */
+static int write_to_file(void *context, const char *data, size_t size)
+{
+    return fwrite(data, 1, size, context) == size ? 0 : -1;
+}
+
+/**
+ * Store the text of the SGR parameters used for a color.
+ *
+ * Arguments:
+ * - dest: Output buffer of the color.
+ * - values: Parameters of the color.
+ * - count: Number of values.
+ */
+static void set_color(char *dest, const long *values, size_t count)
+{
+    char *cursor = dest;
+
+    *cursor = '\0';
+
+    for (size_t n = 0; n < count; n++) {
+        cursor += sprintf(cursor, n ? ";%ld" : "%ld", values[n]);
+    }
+}
+
+/**
+ * Apply the parameters of an SGR escape sequence the way a terminal would.
+ *
+ * Arguments:
+ * - rendition: Attributes to update.
+ * - parameters: Parameters of the escape sequence.
+ */
+static void apply_sgr(rendition_st *rendition, const char *parameters)
+{
+    size_t count = 0;
+    char link[sizeof(rendition->link)];
+    long values[64];
+    size_t width;
+
+    for (const char *cursor = parameters; count < 64; cursor++) {
+        values[count++] = strtol(cursor, (char **) &cursor, 10);
+
+        if (*cursor != ';') {
+            break;
+        }
+    }
+
+    for (size_t n = 0; n < count; n += width) {
+        long value = values[n];
+
+        width = 1;
+
+        if (value == 0) {
+            // Hyperlinks are not attributes, so they are unaffected.
+            strcpy(link, rendition->link);
+            *rendition = (rendition_st) {0};
+            strcpy(rendition->link, link);
+        } else if (value == 1) {
+            rendition->bold = 1;
+        } else if (value == 2) {
+            rendition->faint = 1;
+        } else if (value == 3) {
+            rendition->italic = 1;
+        } else if (value == 4 || value == 21) {
+            rendition->underline = value == 4 ? 1 : 2;
+        } else if (value == 5 || value == 6) {
+            rendition->blink = value == 5 ? 1 : 2;
+        } else if (value == 7) {
+            rendition->reverse = 1;
+        } else if (value == 8) {
+            rendition->hidden = 1;
+        } else if (value == 9) {
+            rendition->strike = 1;
+        } else if (value == 22) {
+            rendition->bold = rendition->faint = 0;
+        } else if (value == 23) {
+            rendition->italic = 0;
+        } else if (value == 24) {
+            rendition->underline = 0;
+        } else if (value == 25) {
+            rendition->blink = 0;
+        } else if (value == 27) {
+            rendition->reverse = 0;
+        } else if (value == 28) {
+            rendition->hidden = 0;
+        } else if (value == 29) {
+            rendition->strike = 0;
+        } else if (value == 53 || value == 55) {
+            rendition->overline = value == 53;
+        } else if (value == 38 || value == 48 || value == 58) {
+            // Extended colors that are incomplete or of an unknown type are
+            // ignored along with the parameter that follows them.
+            width = n + 1 >= count ? 1 : values[n + 1] == 5 ? 3 :
+              values[n + 1] == 2 ? 5 : 2;
+
+            if (n + width > count) {
+                width = count - n;
+            } else if (width > 2) {
+                set_color(value == 38 ? rendition->fgcolor :
+                  value == 48 ? rendition->bgcolor : rendition->ulcolor,
+                  values + n, width);
+            }
+        } else if ((value >= 30 && value <= 37) ||
+          (value >= 90 && value <= 97) || value == 39) {
+            set_color(rendition->fgcolor, value == 39 ? NULL : values + n,
+                      value != 39);
+        } else if ((value >= 40 && value <= 47) ||
+          (value >= 100 && value <= 107) || value == 49) {
+            set_color(rendition->bgcolor, value == 49 ? NULL : values + n,
+                      value != 49);
+        } else if (value == 59) {
+            set_color(rendition->ulcolor, NULL, 0);
+        } else if (strlen(rendition->other) < sizeof(rendition->other) - 8) {
+            sprintf(strchr(rendition->other, '\0'), "%ld;", value);
+        }
+    }
+}
+
+/**
+ * Render text with the terminal model.
+ *
+ * Arguments:
+ * - data: Text to render.
+ * - size: Number of bytes in "data".
+ * - pager: When this is true, the attributes and the hyperlink are reset at
+ *   the start of every line.
+ *
+ * Return: A description of every character with the attributes applied to
+ * it. Newlines are described by an empty line.
+ */
+static char *render(const char *data, size_t size, bool pager)
+{
+    char *description;
+    size_t description_size;
+    FILE *file;
+    const char *start;
+
+    const char *cursor = data;
+    const char *end = data + size;
+    rendition_st rendition = {0};
+
+    if (!(file = open_memstream(&description, &description_size))) {
+        perror("open_memstream");
+        exit(1);
+    }
+
+    while (cursor < end) {
+        if (*cursor == '\n') {
+            fputs("\n", file);
+            cursor++;
+
+            if (pager) {
+                rendition = (rendition_st) {0};
+            }
+        } else if (*cursor == '\0') {
+            cursor++;
+        } else if (*cursor != '\033') {
+            fprintf(file, "%d%d%d%d%d%d%d%d%d fg=%s bg=%s ul=%s other=%s "
+              "link=%s: %c\n", rendition.bold, rendition.faint,
+              rendition.italic, rendition.underline, rendition.blink,
+              rendition.reverse, rendition.hidden, rendition.strike,
+              rendition.overline, rendition.fgcolor, rendition.bgcolor,
+              rendition.ulcolor, rendition.other, rendition.link, *cursor);
+            cursor++;
+        } else if (++cursor < end && *cursor == '[') {
+            // Control sequences end at the first byte from "@" to "~", and
+            // an escape interrupts them.
+            start = ++cursor;
+
+            while (cursor < end && *cursor != '\033' && *cursor != '\n' &&
+              (*cursor < '@' || *cursor > '~')) {
+                cursor++;
+            }
+
+            if (cursor < end && *cursor == 'm' &&
+              strspn(start, "0123456789;") >= (size_t) (cursor - start)) {
+                apply_sgr(&rendition, start);
+            }
+
+            if (cursor < end && *cursor != '\033' && *cursor != '\n') {
+                cursor++;
+            }
+        } else if (cursor < end && *cursor == ']') {
+            // OSC strings end with BEL or ST.
+            start = ++cursor;
+
+            while (cursor < end && *cursor != '\007' && *cursor != '\033' &&
+              *cursor != '\n') {
+                cursor++;
+            }
+
+            if (cursor - start > 2 && !memcmp(start, "8;", 2) &&
+              (start = memchr(start + 2, ';', (size_t) (cursor - start - 2)))
+              && (size_t) (cursor - start) < sizeof(rendition.link)) {
+                memcpy(rendition.link, start + 1, (size_t) (cursor - start));
+                rendition.link[cursor - start - 1] = '\0';
+            }
+
+            if (cursor < end && *cursor == '\007') {
+                cursor++;
+            } else if (cursor + 1 < end && !memcmp(cursor, "\033\\", 2)) {
+                cursor += 2;
+            }
+        } else if (cursor < end && *cursor != '\n' && *cursor != '\033') {
+            // Any other escape sequence is two bytes long, but like the
+            // control sequences, it is interrupted by an escape.
+            cursor++;
+        }
+    }
+
+    fclose(file);
+    return description;
+}
+
+/**
+ * Process text with redundansi.
+ *
+ * Arguments:
+ * - data: Text to process.
+ * - size: Number of bytes in "data".
+ * - minify: Indicates whether the output should be minified.
+ * - block_size: Number of bytes passed to redundansi_feed at a time.
+ * - output_size: Output pointer for the size of the output.
+ *
+ * Return: The output of redundansi.
+ */
+static char *process(const char *data, size_t size, bool minify,
+  size_t block_size, size_t *output_size)
+{
+    FILE *file;
+    char *output;
+    redundansi_st rd;
+
+    if (!(file = open_memstream(&output, output_size))) {
+        perror("open_memstream");
+        exit(1);
+    }
+
+    redundansi_init(&rd);
+    rd.minify = minify;
+
+    for (size_t offset = 0; offset < size; offset += block_size) {
+        redundansi_feed(&rd, data + offset, size - offset < block_size ?
+          size - offset : block_size, write_to_file, file);
+    }
+
+    redundansi_finish(&rd, write_to_file, file);
+    fclose(file);
+    return output;
+}
+
+/**
+ * Report the result of a check.
+ *
+ * Arguments:
+ * - description: Description of the check.
+ * - actual: Rendering or output that was generated.
+ * - expected: Rendering or output that was expected.
+ *
+ * Return: 0 if the text matches and -1 otherwise.
+ */
+static int expect(const char *description, const char *actual,
+  const char *expected)
+{
+    size_t entry = 1;
+    size_t offset = 0;
+
+    if (!strcmp(actual, expected)) {
+        return 0;
+    }
+
+    // Only the first line that differs is shown since renderings describe
+    // each character on a separate line.
+    for (size_t n = 0; actual[n] == expected[n]; n++) {
+        if (actual[n] == '\n') {
+            entry++;
+            offset = n + 1;
+        }
+    }
+
+    fprintf(stderr, "\n%s: line %zu: expected \"%.*s\", got \"%.*s\"",
+      description, entry, (int) strcspn(expected + offset, "\n"),
+      expected + offset, (int) strcspn(actual + offset, "\n"),
+      actual + offset);
+    return -1;
+}
+
+int main(void)
+{
+    char *bytewise;
+    size_t bytewise_size;
+    FILE *file;
+    char input[65536];
+    size_t input_size;
+    char *minified;
+    size_t minified_size;
+    char *output;
+    size_t output_size;
+    char *renderings[5];
+
+    int status = 0;
+
+    if (!(file = fopen("test.in", "r")) ||
+      !(input_size = fread(input, 1, sizeof(input), file))) {
+        perror("test.in");
+        return 1;
+    }
+
+    fclose(file);
+
+    output = process(input, input_size, false, input_size, &output_size);
+    minified = process(input, input_size, true, input_size, &minified_size);
+    renderings[0] = render(input, input_size, false);
+    renderings[1] = render(output, output_size, false);
+    renderings[2] = render(minified, minified_size, false);
+    renderings[3] = render(output, output_size, true);
+    renderings[4] = render(minified, minified_size, true);
+
+    status |= expect("terminal rendering of output", renderings[1],
+      renderings[0]);
+    status |= expect("terminal rendering of minified output", renderings[2],
+      renderings[0]);
+    status |= expect("pager rendering of minified output", renderings[4],
+      renderings[3]);
+
+    bytewise = process(input, input_size, false, 1, &bytewise_size);
+    status |= expect("output fed one byte at a time", bytewise, output);
+    free(bytewise);
+    bytewise = process(input, input_size, true, 1, &bytewise_size);
+    status |= expect("minified output fed one byte at a time", bytewise,
+      minified);
+    free(bytewise);
+
+    for (size_t n = 0; n < ARRAY_LENGTH(renderings); n++) {
+        free(renderings[n]);
+    }
+
+    free(output);
+    free(minified);
+    return status ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * Helpers shared by the statusline test programs. This file must be included
+ * after the statusline source since it relies on the headers included there.
+ * The functions are inline so programs that do not use all of them compile
+ * without warnings.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#ifndef STATUSLINE_TEST_HELPERS_H
+#define STATUSLINE_TEST_HELPERS_H
+
+/**
+ * Write a file, exiting if it cannot be opened.
+ *
+ * Arguments:
+ * - directory: Directory containing the file.
+ * - name: Path of the file relative to "directory".
+ * - text: Contents of the file.
+ */
+static inline void write_file(const char *directory, const char *name,
+  const char *text)
+{
+    FILE *file;
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+
+    if (!(file = fopen(path, "w"))) {
+        perror(path);
+        exit(1);
+    }
+
+    fputs(text, file);
+    fclose(file);
+}
+
+/**
+ * Report the result of a check that computes a number.
+ *
+ * Arguments:
+ * - description: Description of the check.
+ * - actual: Value that was computed.
+ * - expected: Value that was expected.
+ *
+ * Return: 0 if the values match and -1 otherwise.
+ */
+static inline int expect_value(const char *description, int actual,
+  int expected)
+{
+    if (actual != expected) {
+        fprintf(stderr, "\n%s: expected %d, got %d", description, expected,
+          actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Report the result of a check that generates text.
+ *
+ * Arguments:
+ * - description: Description of the check.
+ * - actual: Text that was generated or NULL if there was none.
+ * - expected: Text that was expected.
+ *
+ * Return: 0 if the text matches and -1 otherwise.
+ */
+static inline int expect_text(const char *description, const char *actual,
+  const char *expected)
+{
+    if (!actual || strcmp(actual, expected)) {
+        fprintf(stderr, "\n%s: expected \"%s\", got \"%s\"", description,
+          expected, actual ? actual : "(none)");
+        return -1;
+    }
+
+    return 0;
+}
+
+#endif
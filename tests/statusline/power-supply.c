@@ -0,0 +1,177 @@
+/**
+ * Verify the combined battery indicator using a temporary directory laid out
+ * like "/sys/class/power_supply" in place of sysfs. The attributes are
+ * rewritten between checks to simulate batteries draining, charging and being
+ * removed.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#define main statusline_main
+#include "../../desktop-environment/utilities/statusline.c"
+#undef main
+#include "helpers.h"
+
+/**
+ * Directory standing in for the power supply directory.
+ */
+static char root[] = "/tmp/statusline-power-supply.XXXXXX";
+
+/**
+ * Write an attribute of a power supply, creating the directory of the power
+ * supply if needed. Like sysfs, the value is followed by a newline.
+ *
+ * Arguments:
+ * - supply: Name of the power supply.
+ * - name: Name of the attribute.
+ * - value: Value of the attribute.
+ */
+static void write_attribute(const char *supply, const char *name,
+  const char *value)
+{
+    FILE *file;
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/%s", root, supply);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/%s/%s", root, supply, name);
+
+    if (!(file = fopen(path, "w"))) {
+        perror(path);
+        exit(1);
+    }
+
+    fprintf(file, "%s\n", value);
+    fclose(file);
+}
+
+/**
+ * Remove every attribute of a power supply then the directory itself.
+ *
+ * Arguments:
+ * - supply: Name of the power supply.
+ */
+static void remove_supply(const char *supply)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/%s", root, supply);
+
+    if (!(dir = opendir(path))) {
+        return;
+    }
+
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s/%s", root, supply,
+              entry->d_name);
+            remove(path);
+        }
+    }
+
+    closedir(dir);
+    snprintf(path, sizeof(path), "%s/%s", root, supply);
+    rmdir(path);
+}
+
+int main(void)
+{
+    char path[4096];
+    power_supplies_st single = {0};
+
+    int status = 0;
+    power_supplies_st supplies = {.stale = 1};
+    time_t when = 1000000000;
+
+    if (!mkdtemp(root)) {
+        perror(root);
+        return 1;
+    }
+
+    supplies.directory = root;
+
+    write_attribute("BAT0", "type", "Battery");
+    write_attribute("BAT0", "uevent", "");
+    write_attribute("BAT0", "capacity", "50");
+    write_attribute("BAT0", "status", "Discharging");
+    write_attribute("BAT0", "energy_now", "25000000");
+    write_attribute("BAT0", "energy_full", "50000000");
+    write_attribute("BAT0", "power_now", "10000000");
+    write_attribute("BAT1", "type", "Battery");
+    write_attribute("BAT1", "uevent", "");
+    write_attribute("BAT1", "capacity", "80");
+    write_attribute("BAT1", "status", "Not charging");
+    write_attribute("BAT1", "energy_now", "16000000");
+    write_attribute("BAT1", "energy_full", "20000000");
+    write_attribute("BAT1", "power_now", "0");
+    write_attribute("AC", "type", "Mains");
+    write_attribute("AC", "online", "0");
+
+    // Peripheral batteries do not power the system.
+    write_attribute("hid-mouse", "type", "Battery");
+    write_attribute("hid-mouse", "scope", "Device");
+    write_attribute("hid-mouse", "uevent", "");
+    write_attribute("hid-mouse", "capacity", "5");
+
+    // (50% * 50 Wh + 80% * 20 Wh) / 70 Wh = 59%, 41 Wh / 10 W = 4:06.
+    status |= expect_text("two batteries",
+      power_supply_indicator(&supplies, when), "⚡↓59 4:06");
+
+    // The rate moves 1 - e^-0.5 of the way towards 20 W after a minute.
+    write_attribute("BAT0", "power_now", "20000000");
+    status |= expect_text("smoothed rate",
+      power_supply_indicator(&supplies, when + 60), "⚡↓59 2:57");
+
+    // Without a hotplug event, the supplies are not enumerated again.
+    write_attribute("BAT2", "type", "Battery");
+    write_attribute("BAT2", "uevent", "");
+    write_attribute("BAT2", "capacity", "0");
+    status |= expect_text("no enumeration",
+      power_supply_indicator(&supplies, when + 60), "⚡↓59 2:57");
+
+    remove_supply("BAT1");
+    remove_supply("BAT2");
+    supplies.stale = 1;
+    status |= expect_text("battery removed",
+      power_supply_indicator(&supplies, when + 60), "⚡↓50 1:48");
+
+    // Changing direction discards the smoothed rate: 25 Wh / 20 W = 1:15.
+    write_attribute("AC", "online", "1");
+    write_attribute("BAT0", "status", "Charging");
+    status |= expect_text("charging",
+      power_supply_indicator(&supplies, when + 61), "⚡↑50 1:15");
+
+    // An offline external power supply implies the batteries are draining.
+    write_attribute("AC", "online", "0");
+    write_attribute("BAT0", "status", "Unknown");
+    status |= expect_text("unknown status",
+      power_supply_indicator(&supplies, when + 62), "⚡↓50");
+
+    // A single battery that only has a uevent file reporting its charge.
+    snprintf(path, sizeof(path), "%s/BAT3/uevent", root);
+    write_attribute("BAT3", "uevent",
+      "POWER_SUPPLY_NAME=BAT3\n"
+      "POWER_SUPPLY_STATUS=Charging\n"
+      "POWER_SUPPLY_CHARGE_NOW=2000000\n"
+      "POWER_SUPPLY_CHARGE_FULL=4000000\n"
+      "POWER_SUPPLY_CURRENT_NOW=-1000000\n"
+      "POWER_SUPPLY_CAPACITY=57");
+    init_battery(&single.batteries[0], path);
+    single.battery_count = 1;
+    status |= expect_text("uevent battery",
+      power_supply_indicator(&single, when), "⚡↑57 2:00");
+
+    remove_supply("BAT0");
+    remove_supply("BAT3");
+    remove_supply("hid-mouse");
+    supplies.stale = 1;
+    status |= expect_text("no batteries",
+      power_supply_indicator(&supplies, when + 63), "");
+
+    remove_supply("AC");
+    rmdir(root);
+
+    return status ? 1 : 0;
+}
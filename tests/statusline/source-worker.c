@@ -0,0 +1,163 @@
+/**
+ * Verify that the source worker publishes snapshots of the status file and
+ * the batteries as they change, and that a snapshot the main thread has not
+ * taken is replaced by the next one. The worker runs against a status file
+ * and a power supply directory in a temporary directory.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#define main statusline_main
+#include "../../desktop-environment/utilities/statusline.c"
+#undef main
+#include "helpers.h"
+
+/**
+ * Directory containing the status file and the power supply directory.
+ */
+static char root[] = "/tmp/statusline-source-worker.XXXXXX";
+
+/**
+ * Wait for the worker to publish a snapshot then take it.
+ *
+ * Arguments:
+ * - sources: Sources refreshed by the worker.
+ * - wake_fd: Read end of the pipe the worker writes to.
+ *
+ * Return: The snapshot or NULL if none was published within a few seconds.
+ */
+static source_snapshot_st *take_snapshot(sources_st *sources, int wake_fd)
+{
+    fd_set fds;
+    struct timeval timeout = {.tv_sec = 3};
+
+    FD_ZERO(&fds);
+    FD_SET(wake_fd, &fds);
+
+    if (select(wake_fd + 1, &fds, NULL, NULL, &timeout) != 1) {
+        return NULL;
+    }
+
+    drain_pipe(wake_fd);
+    return exchange_snapshot(sources, NULL);
+}
+
+int main(void)
+{
+    char directory[4096];
+    char path[4096];
+    source_snapshot_st *snapshot;
+    char temporary[4096];
+    int wake_pipe[2];
+    pthread_t worker;
+
+    static const char *const created[] = {
+        "power_supply/BAT0/capacity",
+        "power_supply/BAT0/status",
+        "power_supply/BAT0/type",
+        "power_supply/BAT0/uevent",
+        "power_supply/BAT0",
+        "power_supply",
+        "status",
+    };
+
+    int status = 0;
+    sources_st empty = {.lock = PTHREAD_MUTEX_INITIALIZER, .notify_fd = -1};
+    sources_st idle = {.lock = PTHREAD_MUTEX_INITIALIZER, .notify_fd = -1};
+    sources_st sources = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .battery_interval = BATTERY_EVENT_REFRESH_SEC,
+        .uevent_socket = -1,
+        .status_name = "status",
+        .status_file_mt = -1,
+    };
+
+    // Snapshots that are not taken are replaced without waking anyone.
+    strcpy(idle.current.status_file, "first");
+    publish_sources(&idle);
+    strcpy(idle.current.status_file, "second");
+    publish_sources(&idle);
+    snapshot = exchange_snapshot(&idle, NULL);
+    status |= expect_text("replaced snapshot",
+      snapshot ? snapshot->status_file : NULL, "second");
+    free(snapshot);
+
+    if (exchange_snapshot(&idle, NULL)) {
+        fputs("\ntaken snapshot: still pending", stderr);
+        status = 1;
+    }
+
+    // The first refresh is published even when there is no text, so the
+    // main thread does not wait for a snapshot that never comes.
+    status |= expect_value("first refresh of empty sources",
+      refresh_sources(&empty, 0), 1);
+    status |= expect_value("second refresh of empty sources",
+      refresh_sources(&empty, 0), 0);
+
+    if (!mkdtemp(root) || pipe(wake_pipe)) {
+        perror(root);
+        return 1;
+    }
+
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+    sources.notify_fd = wake_pipe[1];
+
+    snprintf(directory, sizeof(directory), "%s/power_supply", root);
+    mkdir(directory, 0700);
+    snprintf(path, sizeof(path), "%s/BAT0", directory);
+    mkdir(path, 0700);
+    write_file(root, "power_supply/BAT0/type", "Battery\n");
+    write_file(root, "power_supply/BAT0/uevent", "");
+    write_file(root, "power_supply/BAT0/capacity", "50\n");
+    write_file(root, "power_supply/BAT0/status", "Not charging\n");
+    sources.power_supplies.directory = directory;
+    sources.power_supplies.stale = 1;
+
+    write_file(root, "status", "one\n");
+    snprintf(path, sizeof(path), "%s/status", root);
+    sources.status_file = path;
+
+    if ((sources.status_watch = open_status_file_watch(path)) == -1) {
+        perror(path);
+        return 1;
+    }
+
+    if ((errno = pthread_create(&worker, NULL, run_source_worker,
+      &sources))) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    snapshot = take_snapshot(&sources, wake_pipe[0]);
+    status |= expect_text("initial status file",
+      snapshot ? snapshot->status_file : NULL, "one" SEPARATOR);
+    status |= expect_text("initial battery",
+      snapshot ? snapshot->battery : NULL, "⚡50" SEPARATOR);
+    free(snapshot);
+
+    // The new text is published as soon as the file is replaced.
+    write_file(root, "status.tmp", "two\nthree\n");
+    snprintf(temporary, sizeof(temporary), "%s/status.tmp", root);
+    rename(temporary, path);
+    snapshot = take_snapshot(&sources, wake_pipe[0]);
+    status |= expect_text("replaced status file",
+      snapshot ? snapshot->status_file : NULL,
+      "two" SEPARATOR "three" SEPARATOR);
+    status |= expect_text("unchanged battery",
+      snapshot ? snapshot->battery : NULL, "⚡50" SEPARATOR);
+    free(snapshot);
+
+    pthread_cancel(worker);
+    pthread_join(worker, NULL);
+
+    // Directories are listed after their contents since remove(3) only
+    // removes empty directories.
+    for (size_t k = 0; k < ARRAY_LENGTH(created); k++) {
+        snprintf(path, sizeof(path), "%s/%s", root, created[k]);
+        remove(path);
+    }
+
+    rmdir(root);
+    return status ? 1 : 0;
+}
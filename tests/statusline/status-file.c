@@ -0,0 +1,118 @@
+/**
+ * Verify that changes to the status file are detected by watching the
+ * directory containing it. The file is replaced, rewritten and removed in a
+ * temporary directory, and other files in the same directory are modified to
+ * make sure they are ignored.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#define main statusline_main
+#include "../../desktop-environment/utilities/statusline.c"
+#undef main
+#include "helpers.h"
+
+/**
+ * Directory containing the status file.
+ */
+static char root[] = "/tmp/statusline-status-file.XXXXXX";
+
+/**
+ * Rename a file in the temporary directory.
+ *
+ * Arguments:
+ * - from: Name of the file.
+ * - to: New name of the file.
+ */
+static void rename_file(const char *from, const char *to)
+{
+    char source[4096];
+    char target[4096];
+
+    snprintf(source, sizeof(source), "%s/%s", root, from);
+    snprintf(target, sizeof(target), "%s/%s", root, to);
+    rename(source, target);
+}
+
+/**
+ * Remove a file from the temporary directory.
+ *
+ * Arguments:
+ * - name: Name of the file.
+ */
+static void remove_file(const char *name)
+{
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    remove(path);
+}
+
+int main(void)
+{
+    char path[4096];
+    char link[4096];
+    int watch;
+
+    int status = 0;
+
+    if (!mkdtemp(root)) {
+        perror(root);
+        return 1;
+    }
+
+    write_file(root, "status", "one\n");
+    snprintf(path, sizeof(path), "%s/status", root);
+
+    if ((watch = open_status_file_watch(path)) == -1) {
+        perror(root);
+        return 1;
+    }
+
+    status |= expect_value("no events",
+      read_status_file_events(watch, "status"), 0);
+
+    write_file(root, "other", "ignored\n");
+    status |= expect_value("other file",
+      read_status_file_events(watch, "status"), 0);
+
+    write_file(root, "status.tmp", "two\n");
+    rename_file("status.tmp", "status");
+    status |= expect_value("replaced",
+      read_status_file_events(watch, "status"), STATUS_FILE_CHANGED);
+    status |= expect_value("drained",
+      read_status_file_events(watch, "status"), 0);
+
+    write_file(root, "status", "three\n");
+    status |= expect_value("rewritten",
+      read_status_file_events(watch, "status"), STATUS_FILE_CHANGED);
+
+    // A change ends the source worker's wait.
+    write_file(root, "status.tmp", "four\n");
+    rename_file("status.tmp", "status");
+    status |= expect_value("wait with change",
+      wait_for_sources(-1, watch, "status", 1), STATUS_FILE_CHANGED);
+
+    write_file(root, "other", "still ignored\n");
+    status |= expect_value("wait with other file",
+      wait_for_sources(-1, watch, "status", 1), 0);
+
+    // Symbolic links are polled instead of watched.
+    snprintf(link, sizeof(link), "%s/link", root);
+    status |= expect_value("symbolic link", symlink(path, link) ||
+      open_status_file_watch(link) != -1, 0);
+    remove_file("link");
+
+    remove_file("status");
+    status |= expect_value("removed", read_status_file_events(watch, "status"),
+      STATUS_FILE_CHANGED);
+
+    remove_file("other");
+    rmdir(root);
+    status |= expect_value("directory removed",
+      read_status_file_events(watch, "status"),
+      STATUS_FILE_CHANGED | STATUS_FILE_UNWATCHED);
+
+    close(watch);
+    return status ? 1 : 0;
+}
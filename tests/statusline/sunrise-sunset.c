@@ -0,0 +1,140 @@
+/**
+ * Verify that the cached sunrise and sunset indicator always shows the same
+ * text as computing the next event from scratch. Each case walks through the
+ * days surrounding a daylight saving time transition, checking every second
+ * around each change of the expected text, then walks backwards to simulate
+ * the clock being set to an earlier time.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#define main statusline_main
+#include "../../desktop-environment/utilities/statusline.c"
+#undef main
+
+/**
+ * Time zone, location and the UNIX timestamp of a transition that is tested.
+ */
+typedef struct {
+    const char *zone;
+    double latitude;
+    double longitude;
+    time_t transition;
+} test_case_st;
+
+/**
+ * Compute the expected text of the indicator without any caching.
+ *
+ * Arguments:
+ * - dest: Output buffer.
+ * - sizeofdest: Size of "dest".
+ * - test: Location being tested.
+ * - when: Current time.
+ */
+static void expected_text(char *dest, size_t sizeofdest,
+  const test_case_st *test, time_t when)
+{
+    time_t event;
+    int is_sunrise;
+
+    event = next_sunrise_or_sunset(when, test->latitude, test->longitude,
+        &is_sunrise);
+
+    if (!strftime(dest, sizeofdest, is_sunrise ? "🌅 %R" : "🌙 %R",
+      localtime(&event))) {
+        strncpy(dest, "⚠️", sizeofdest);
+    }
+}
+
+/**
+ * Compare the cached text with the expected text at a given time.
+ *
+ * Arguments:
+ * - test: Location being tested.
+ * - when: Current time.
+ *
+ * Return: 0 if the text matched and -1 otherwise.
+ */
+static int check(const test_case_st *test, time_t when)
+{
+    const char *actual;
+    char expected[64];
+
+    expected_text(expected, sizeof(expected), test, when);
+    actual = sunrise_sunset_info(when, test->latitude, test->longitude, NULL);
+
+    if (strcmp(actual, expected)) {
+        fprintf(stderr, "\n%s @%lld: expected \"%s\", got \"%s\"", test->zone,
+          (long long) when, expected, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    char previous[64];
+    char text[64];
+    time_t when;
+
+    int status = 0;
+
+    static const test_case_st tests[] = {
+        {"America/New_York", 40.71, -74.01, 1710054000},
+        {"America/New_York", 40.71, -74.01, 1730613600},
+        {"Europe/London", 51.51, -0.13, 1711846800},
+        {"Europe/London", 51.51, -0.13, 1729990800},
+        {"Australia/Sydney", -33.87, 151.21, 1712419200},
+        {"Australia/Sydney", -33.87, 151.21, 1728144000},
+        // Daylight saving time starts at midnight in Chile.
+        {"America/Santiago", -33.45, -70.67, 1725768000},
+        {"Asia/Kolkata", 28.61, 77.21, 1710054000},
+    };
+
+    for (size_t k = 0; k < ARRAY_LENGTH(tests); k++) {
+        const test_case_st *test = &tests[k];
+
+        // The zones are switched without resetting the cache, so this also
+        // verifies that changes to the UTC offset are detected.
+        setenv("TZ", test->zone, 1);
+        tzset();
+        expected_text(previous, sizeof(previous), test,
+          test->transition - 3 * 86400);
+
+        for (when = test->transition - 3 * 86400;
+          when < test->transition + 3 * 86400; when += 60) {
+            expected_text(text, sizeof(text), test, when);
+
+            // Check every second leading up to a change in the text.
+            if (strcmp(text, previous)) {
+                for (time_t second = when - 59; second < when; second++) {
+                    status |= check(test, second);
+                }
+
+                strcpy(previous, text);
+            }
+
+            status |= check(test, when);
+        }
+
+        for (; when > test->transition - 3 * 86400; when -= 3607) {
+            status |= check(test, when);
+        }
+    }
+
+    // When only the time zone changes, the cached event is still the next
+    // one, but it must be displayed in the new zone.
+    for (size_t k = 0; k < 2; k++) {
+        static const test_case_st zones[] = {
+            {"America/New_York", 40.71, -74.01, 1730613600},
+            {"America/Chicago", 40.71, -74.01, 1730613600},
+        };
+
+        setenv("TZ", zones[k].zone, 1);
+        tzset();
+        status |= check(&zones[k], zones[k].transition + (time_t) k);
+    }
+
+    return status ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * Verify the handling of power supply uevents using a datagram socket pair
+ * as a stand-in for the kernel's netlink socket. Synthetic uevents are
+ * written to one end, and the other end is passed to the functions used by
+ * the main loop.
+ *
+ * Copyright: Eric Pruitt (https://www.codevat.com/)
+ * License: BSD 2-Clause License (https://opensource.org/licenses/BSD-2-Clause)
+ */
+#define main statusline_main
+#include "../../desktop-environment/utilities/statusline.c"
+#undef main
+#include "helpers.h"
+
+/**
+ * Synthetic uevent from the power_supply subsystem.
+ */
+static const char power_supply_event[] =
+    "change@/devices/LNXSYSTM:00/LNXSYBUS:00/PNP0C0A:00/power_supply/BAT0\0"
+    "ACTION=change\0"
+    "DEVPATH=/devices/LNXSYSTM:00/LNXSYBUS:00/PNP0C0A:00/power_supply/BAT0\0"
+    "SUBSYSTEM=power_supply\0"
+    "POWER_SUPPLY_NAME=BAT0\0"
+    "POWER_SUPPLY_STATUS=Charging\0"
+    "POWER_SUPPLY_CAPACITY=57\0"
+    "SEQNUM=4242";
+
+/**
+ * Synthetic uevent announcing that a power supply was added.
+ */
+static const char power_supply_add_event[] =
+    "add@/devices/pci0000:00/0000:00:14.0/usb1/1-1/power_supply/ucsi-1\0"
+    "ACTION=add\0"
+    "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-1/power_supply/ucsi-1\0"
+    "SUBSYSTEM=power_supply\0"
+    "POWER_SUPPLY_NAME=ucsi-1\0"
+    "SEQNUM=4244";
+
+/**
+ * Synthetic uevent from another subsystem that mentions power_supply.
+ */
+static const char usb_event[] =
+    "add@/devices/pci0000:00/0000:00:14.0/usb1/1-1\0"
+    "ACTION=add\0"
+    "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-1\0"
+    "SUBSYSTEM=usb\0"
+    "DEVTYPE=usb_device\0"
+    "PRODUCT=power_supply\0"
+    "SEQNUM=4243";
+
+int main(void)
+{
+    int fds[2];
+
+    int status = 0;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds)) {
+        perror("socketpair");
+        return 1;
+    }
+
+    status |= expect_value("no uevents", read_uevents(fds[0]), 0);
+
+    send(fds[1], power_supply_event, sizeof(power_supply_event) - 1, 0);
+    status |= expect_value("power_supply uevent", read_uevents(fds[0]), 1);
+    status |= expect_value("drained", read_uevents(fds[0]), 0);
+
+    send(fds[1], usb_event, sizeof(usb_event) - 1, 0);
+    status |= expect_value("usb uevent", read_uevents(fds[0]), 0);
+
+    // Only power supplies being added or removed are reported as hotplug
+    // events, so adding a USB device does not count.
+    send(fds[1], usb_event, sizeof(usb_event) - 1, 0);
+    send(fds[1], power_supply_add_event, sizeof(power_supply_add_event) - 1,
+      0);
+    status |= expect_value("power_supply hotplug uevent", read_uevents(fds[0]),
+      UEVENT_POWER_SUPPLY | UEVENT_POWER_SUPPLY_HOTPLUG);
+
+    send(fds[1], usb_event, sizeof(usb_event) - 1, 0);
+    send(fds[1], power_supply_event, sizeof(power_supply_event) - 1, 0);
+    send(fds[1], usb_event, sizeof(usb_event) - 1, 0);
+    status |= expect_value("mixed uevents", read_uevents(fds[0]), 1);
+    status |= expect_value("mixed uevents drained", read_uevents(fds[0]), 0);
+
+    // A pending power supply uevent ends the source worker's wait.
+    send(fds[1], power_supply_event, sizeof(power_supply_event) - 1, 0);
+    status |= expect_value("wait with power_supply uevent",
+      wait_for_sources(fds[0], -1, NULL, 1), 1);
+
+    // Unrelated uevents do not, but the wait still ends after the timeout.
+    send(fds[1], usb_event, sizeof(usb_event) - 1, 0);
+    status |= expect_value("wait with usb uevent",
+      wait_for_sources(fds[0], -1, NULL, 1), 0);
+
+    return status ? 1 : 0;
+}